@@ -0,0 +1,52 @@
+// this shader applies one 1D pass of a separable gaussian blur
+// each group caches a line segment plus radius on both sides in shared memory
+#version 450 core
+
+#define GROUP 256
+#define MAX_RADIUS 10
+
+layout (local_size_x=GROUP, local_size_y=1, local_size_z=1) in;
+
+layout (r8, binding=0) readonly  uniform image2D imageIn;
+layout (r8, binding=1) writeonly uniform image2D imageOut;
+
+// rows first, then columns
+uniform bool vertical;
+uniform int radius;
+// weights[i] for offset +-i, normalized on CPU
+uniform float weights[MAX_RADIUS + 1];
+// quantization is applied after blurring (last pass only)
+uniform int shades;
+// first pixel of processed region (tracking ROI)
+uniform ivec2 roiOrigin;
+
+shared float line[GROUP + 2 * MAX_RADIUS];
+
+void main()
+{
+    ivec2 size = imageSize(imageIn);
+    int length = vertical ? size.y : size.x;
+    // x of group runs along the blur direction, y picks the row (or column)
+    ivec2 origin = vertical ? roiOrigin.yx : roiOrigin;
+    int along = int(gl_GlobalInvocationID.x) + origin.x;
+    int across = int(gl_WorkGroupID.y) + origin.y;
+    int start = int(gl_WorkGroupID.x) * GROUP + origin.x - MAX_RADIUS;
+    for(int i = int(gl_LocalInvocationID.x); i < GROUP + 2 * MAX_RADIUS; i += GROUP)
+    {
+        // clamp to edge
+        int p = clamp(start + i, 0, length - 1);
+        line[i] = imageLoad(imageIn, vertical ? ivec2(across, p) : ivec2(p, across)).r;
+    }
+    barrier();
+    if(along >= length) return;
+    int center = int(gl_LocalInvocationID.x) + MAX_RADIUS;
+    float sum = line[center] * weights[0];
+    for(int i = 1; i <= radius; i++)
+        sum += (line[center - i] + line[center + i]) * weights[i];
+    if(shades > 1)
+    {
+        float convert = 1.0 / (shades - 1.0);
+        sum = floor(sum / convert + 0.5) * convert;
+    }
+    imageStore(imageOut, vertical ? ivec2(across, along) : ivec2(along, across), vec4(sum));
+}
\ No newline at end of file
@@ -1,95 +1,61 @@
-// this shader denoise an image by applying spatial filter with guassian kernel
-#version 450 core
-
-#define INV_PI          0.31830988618379067153776752674503
-#define INV_SQRT_OF_2PI 0.39894228040143267793994605993439 // 1.0/SQRT_OF_2PI
-
-layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
-
-layout (rgba32f, binding=0) readonly  uniform image2D imageIn;
-layout (rgba32f, binding=1) writeonly uniform image2D imageOut;
-
-uniform float coeff_sigma;
-uniform float coeff_kSigma;
-uniform float coeff_threshold;
-
+// this shader denoise an image by applying bilateral filter (spatial + range gaussian)
 // reference: https://github.com/BrutPitt/glslSmartDeNoise
-vec4 smartDeNoise(ivec2 uv, float sigma, float kSigma, float threshold)
-{
-    float radius = round(kSigma * sigma);
-    float radQ = radius * radius;
-
-    float invSigmaQx2 = 0.5 / (sigma * sigma);      // 1.0 / (sigma^2 * 2.0)
-    float invSigmaQx2PI = INV_PI * invSigmaQx2;    // 1/(2 * PI * sigma^2)
-
-    float invThresholdSqx2 = 0.5 / (threshold * threshold);     // 1.0 / (sigma^2 * 2.0)
-    float invThresholdSqrt2PI = INV_SQRT_OF_2PI / threshold;   // 1.0 / (sqrt(2*PI) * sigma^2)
+// tile plus halo is cached in shared memory, both weights come from tables built on CPU
+#version 450 core
 
-    vec4 centrPx = imageLoad(imageIn, uv); 
+#define TILE     32
+// max filter radius
+#define HALO     8
+#define CACHE    (TILE + 2 * HALO)
+#define LUT_SIZE 64
 
-    float zBuff = 0.0;
-    vec4 aBuff = vec4(0.0);
+layout (local_size_x=TILE, local_size_y=TILE, local_size_z=1) in;
 
-    vec2 d;
-    for (d.x = -radius; d.x <= radius; d.x++) {
-        float pt = sqrt(radQ - d.x * d.x);       // pt = yRadius: have circular trend
-        for (d.y = -pt; d.y <= pt; d.y++) {
-            float blurFactor = exp(-dot(d, d) * invSigmaQx2) * invSigmaQx2PI;
+layout (rgba8, binding=0) readonly  uniform image2D imageIn;
+layout (rgba8, binding=1) writeonly uniform image2D imageOut;
 
-            vec4 walkPx = imageLoad(imageIn, uv + ivec2(d));
-            vec4 dC = walkPx - centrPx;
-            float deltaFactor = exp(-dot(dC, dC) * invThresholdSqx2) * invThresholdSqrt2PI * blurFactor;
+uniform int radius;
+// spatialWeights[|dy| * (HALO + 1) + |dx|], zero outside circular window
+uniform float spatialWeights[(HALO + 1) * (HALO + 1)];
+// rangeWeights[squared color distance * rangeScale], last entry is zero
+uniform float rangeWeights[LUT_SIZE];
+uniform float rangeScale;
 
-            zBuff += deltaFactor;
-            aBuff += deltaFactor * walkPx;
-        }
-    }
-    return aBuff / zBuff;
-}
+// rgba8 packed, a quarter of the shared memory of vec4
+shared uint tile[CACHE][CACHE];
 
-vec4 smartDeNoise_lum(ivec2 uv, float sigma, float kSigma, float threshold)
+void main()
 {
-    float radius = round(kSigma * sigma);
-    float radQ = radius * radius;
-
-    float invSigmaQx2 = 0.5 / (sigma * sigma);      // 1.0 / (sigma^2 * 2.0)
-    float invSigmaQx2PI = INV_PI * invSigmaQx2;    // // 1/(2 * PI * sigma^2)
-
-    float invThresholdSqx2 = 0.5 / (threshold * threshold);     // 1.0 / (sigma^2 * 2.0)
-    float invThresholdSqrt2PI = INV_SQRT_OF_2PI / threshold;   // 1.0 / (sqrt(2*PI) * sigma)
-
-
-    vec3 c = imageLoad(imageIn, uv).rgb;
-    float centrLum = dot(c, vec3(0.299, 0.587, 0.114));
-
+    ivec2 size = imageSize(imageIn);
+    // whole group cooperatively loads tile and halo once, clamp to edge
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - ivec2(HALO);
+    for(int i = int(gl_LocalInvocationIndex); i < CACHE * CACHE; i += TILE * TILE)
+    {
+        ivec2 cell = ivec2(i % CACHE, i / CACHE);
+        ivec2 uv = clamp(origin + cell, ivec2(0), size - ivec2(1));
+        tile[cell.y][cell.x] = packUnorm4x8(imageLoad(imageIn, uv));
+    }
+    barrier();
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy);
+    if(baseUV.x >= size.x || baseUV.y >= size.y) return;
+    ivec2 local = ivec2(gl_LocalInvocationID.xy) + ivec2(HALO);
+    vec4 centrPx = unpackUnorm4x8(tile[local.y][local.x]);
     float zBuff = 0.0;
     vec4 aBuff = vec4(0.0);
-
-    vec2 d;
-    for (d.x = -radius; d.x <= radius; d.x++) {
-        float pt = sqrt(radQ - d.x * d.x);       // pt = yRadius: have circular trend
-        for (d.y=-pt; d.y <= pt; d.y++) {
-            float blurFactor = exp(-dot(d, d) * invSigmaQx2) * invSigmaQx2PI;
-
-            vec4 walkPx = imageLoad(imageIn, uv + ivec2(d));
-
-            float dC = dot(walkPx.rgb, vec3(0.299, 0.587, 0.114)) - centrLum;
-            float deltaFactor = exp(-(dC * dC) * invThresholdSqx2) * invThresholdSqrt2PI * blurFactor;
-
+    for(int dy = -radius; dy <= radius; dy++)
+    {
+        for(int dx = -radius; dx <= radius; dx++)
+        {
+            float blurFactor = spatialWeights[abs(dy) * (HALO + 1) + abs(dx)];
+            if(blurFactor == 0.0) continue;
+            vec4 walkPx = unpackUnorm4x8(tile[local.y + dy][local.x + dx]);
+            vec4 dC = walkPx - centrPx;
+            int index = min(int(dot(dC, dC) * rangeScale), LUT_SIZE - 1);
+            float deltaFactor = rangeWeights[index] * blurFactor;
             zBuff += deltaFactor;
             aBuff += deltaFactor * walkPx;
         }
     }
-    return aBuff / zBuff;
+    // center pixel always has weight 1
+    imageStore(imageOut, baseUV, aBuff / zBuff);
 }
-
-void main()
-{
-    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy);
-    baseUV = clamp(baseUV, ivec2(0), imageSize(imageIn) - ivec2(1));
-    vec3 imgColor = imageLoad(imageIn, baseUV).rgb;
-    
-    vec4 denoised = smartDeNoise(baseUV, coeff_sigma, coeff_kSigma, coeff_threshold);
-
-    imageStore(imageOut, baseUV, denoised);
-}
\ No newline at end of file
@@ -3,17 +3,66 @@
 
 #define PI_2 6.283185307179586
 
+#define LUMA_RGB   0
+#define LUMA_ALPHA 1
+#define LUMA_RED   2
+
+// variant defines (see Marker::preprocess), defaults for plain compile
+#ifndef LUMA_LAYOUT
+#define LUMA_LAYOUT LUMA_RGB
+#endif
+// capture pixels per output pixel along each axis (decimated detection)
+#ifndef SAMPLE_SCALE
+#define SAMPLE_SCALE 1
+#endif
+#ifndef BLUR_FILTER
+#define BLUR_FILTER 0
+#endif
+// luma is quantized to shades levels
+#ifndef QUANTIZE
+#define QUANTIZE 0
+#endif
+
 layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
 
-layout (rgba32f, binding=0) readonly  uniform image2D imageIn;
-layout (r32f,    binding=1) writeonly uniform image2D imageOut;
+// camera image (rgba8) or decoded luma (r8)
+uniform sampler2D imageIn;
+layout (r8, binding=1) writeonly uniform image2D imageOut;
 
 uniform int shades;
-uniform bool blurFilter;
+// first pixel of processed region (tracking ROI), multiple of 32
+uniform ivec2 roiOrigin;
 uniform float blurRadius;
 uniform float blurQuality;
 uniform float blurDirections;
 
+// raw camera formats already carry luma in alpha, decoded MJPG luma in red
+vec3 loadColor(ivec2 uv)
+{
+    vec4 color = texelFetch(imageIn, uv, 0);
+#if LUMA_LAYOUT == LUMA_ALPHA
+    return vec3(color.a);
+#elif LUMA_LAYOUT == LUMA_RED
+    return vec3(color.r);
+#else
+    return color.rgb;
+#endif
+}
+
+// average of the block covered by one output pixel, rows go up from srcUV
+vec3 loadBlock(ivec2 srcUV, ivec2 bounds)
+{
+#if SAMPLE_SCALE > 1
+    vec3 sum = vec3(0.0);
+    for(int j = 0; j < SAMPLE_SCALE; j++)
+        for(int i = 0; i < SAMPLE_SCALE; i++)
+            sum += loadColor(clamp(srcUV + ivec2(i, -j), ivec2(0), bounds));
+    return sum / float(SAMPLE_SCALE * SAMPLE_SCALE);
+#else
+    return loadColor(srcUV);
+#endif
+}
+
 void blur(inout vec3 imgColor, ivec2 baseUV, ivec2 bounds)
 {
     float counts = 0.0;
@@ -25,7 +74,7 @@ void blur(inout vec3 imgColor, ivec2 baseUV, ivec2 bounds)
             ivec2 uv = ivec2(vec2(cos(d), sin(d)) * blurRadius * i) + baseUV;
             if(uv.x >= 0 && uv.y >= 0 && uv.x <= bounds.x && uv.y <= bounds.y)
             {
-                imgColor += imageLoad(imageIn, uv).rgb;
+                imgColor += loadColor(uv);
                 counts += 1.0;
             }
         }
@@ -38,23 +87,23 @@ float grayscale(vec3 imgColor, int n)
     // float grayscale = dot(imgColor, vec3(0.33333333));
     // https://en.wikipedia.org/wiki/Luma_(video)
     float color = dot(imgColor, vec3(0.299, 0.587, 0.114));
-    if(n > 1)
-    {
-        float convert = 1.0 / (n - 1.0);
-        color = floor(color / convert + 0.5) * convert;
-    }
+#if QUANTIZE
+    float convert = 1.0 / (n - 1.0);
+    color = floor(color / convert + 0.5) * convert;
+#endif
     return color;
 }
 
 void main()
 {
-    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy);
-    ivec2 size = imageSize(imageIn) - ivec2(1);
-    baseUV = clamp(baseUV, ivec2(0), size);
-    vec3 imgColor = imageLoad(imageIn, baseUV).rgb;
-    if(blurFilter)
-    {
-        blur(imgColor, baseUV, size);
-    }
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy) + roiOrigin;
+    ivec2 size = textureSize(imageIn, 0) - ivec2(1);
+    baseUV = clamp(baseUV, ivec2(0), imageSize(imageOut) - ivec2(1));
+    // camera image is stored top-down, output starts from bottom left
+    ivec2 srcUV = ivec2(baseUV.x * SAMPLE_SCALE, size.y - baseUV.y * SAMPLE_SCALE);
+    vec3 imgColor = loadBlock(srcUV, size);
+#if BLUR_FILTER
+    blur(imgColor, srcUV, size);
+#endif
     imageStore(imageOut, baseUV, vec4(grayscale(imgColor, shades)));
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+// this shader builds a 256 bin luma histogram for Otsu thresholding
+// bins are counted in shared memory, then merged into the global histogram
+#version 450 core
+
+layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
+
+layout (r8, binding=0) readonly uniform image2D imageIn;
+// cleared before dispatch, level is written by otsu.comp.glsl
+layout (std430, binding=1) buffer Histogram
+{
+    uint bins[256];
+    float otsuLevel;
+};
+
+// first pixel of processed region (tracking ROI), multiple of 32
+uniform ivec2 roiOrigin;
+
+shared uint groupBins[256];
+
+void main()
+{
+    uint index = gl_LocalInvocationIndex;
+    if(index < 256) groupBins[index] = 0;
+    barrier();
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy) + roiOrigin;
+    if(all(lessThan(baseUV, imageSize(imageIn))))
+        atomicAdd(groupBins[uint(imageLoad(imageIn, baseUV).r * 255.0 + 0.5)], 1u);
+    barrier();
+    // one global atomic per non-empty bin and group
+    if(index < 256 && groupBins[index] > 0) atomicAdd(bins[index], groupBins[index]);
+}
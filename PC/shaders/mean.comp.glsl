@@ -0,0 +1,28 @@
+// this shader sums the grayscale image into a buffer for global mean threshold
+// one shared counter per group, one global atomic per group
+#version 450 core
+
+layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
+
+layout (r8, binding=0) readonly uniform image2D imageIn;
+// sum of 8-bit luma values, cleared before dispatch (fits up to 16M pixels)
+layout (std430, binding=0) buffer LumaSum
+{
+    uint lumaSum;
+};
+
+// first pixel of processed region (tracking ROI), multiple of 32
+uniform ivec2 roiOrigin;
+
+shared uint groupSum;
+
+void main()
+{
+    if(gl_LocalInvocationIndex == 0) groupSum = 0;
+    barrier();
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy) + roiOrigin;
+    if(all(lessThan(baseUV, imageSize(imageIn))))
+        atomicAdd(groupSum, uint(imageLoad(imageIn, baseUV).r * 255.0 + 0.5));
+    barrier();
+    if(gl_LocalInvocationIndex == 0) atomicAdd(lumaSum, groupSum);
+}
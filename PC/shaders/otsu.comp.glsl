@@ -0,0 +1,55 @@
+// this shader picks the Otsu threshold from the luma histogram
+// (level maximizing between-class variance), single group, one thread per bin
+#version 450 core
+
+layout (local_size_x=256, local_size_y=1, local_size_z=1) in;
+
+layout (std430, binding=1) buffer Histogram
+{
+    uint bins[256];
+    float otsuLevel;
+};
+
+// running sums of probability and probability * bin
+shared float weight[256];
+shared float moment[256];
+shared float variance[256];
+shared uint best[256];
+
+void main()
+{
+    uint i = gl_LocalInvocationIndex;
+    weight[i] = float(bins[i]);
+    moment[i] = float(bins[i]) * float(i);
+    barrier();
+    // inclusive scan (Hillis-Steele)
+    for(uint offset = 1; offset < 256; offset <<= 1)
+    {
+        float w = i >= offset ? weight[i - offset] : 0.0;
+        float m = i >= offset ? moment[i - offset] : 0.0;
+        barrier();
+        weight[i] += w;
+        moment[i] += m;
+        barrier();
+    }
+    float total = weight[255];
+    float w0 = weight[i] / total;
+    float w1 = 1.0 - w0;
+    float meanTotal = moment[255] / total;
+    float between = meanTotal * w0 - moment[i] / total;
+    variance[i] = w0 > 0.0 && w1 > 0.0 ? between * between / (w0 * w1) : 0.0;
+    best[i] = i;
+    barrier();
+    // arg max
+    for(uint stride = 128; stride > 0; stride >>= 1)
+    {
+        if(i < stride)
+        {
+            uint other = best[i + stride];
+            if(variance[other] > variance[best[i]]) best[i] = other;
+        }
+        barrier();
+    }
+    // bins up to best are black
+    if(i == 0) otsuLevel = (float(best[0]) + 0.5) / 255.0;
+}
@@ -0,0 +1,209 @@
+// this shader fuses grayscale, blur and threshold into one pass
+// luma of a tile plus blur halo is cached in shared memory,
+// only the binary images are written
+#version 450 core
+
+#define PI_2 6.283185307179586
+
+#define LUMA_RGB   0
+#define LUMA_ALPHA 1
+#define LUMA_RED   2
+
+#define BLUR_DIRECTIONAL 0
+#define BLUR_GAUSSIAN    1
+
+#define TILE  32
+// max blur radius (UI limit)
+#define HALO  10
+#define CACHE (TILE + 2 * HALO)
+
+// variant defines (see Marker::preprocess), defaults for plain compile
+#ifndef LUMA_LAYOUT
+#define LUMA_LAYOUT LUMA_RGB
+#endif
+// capture pixels per output pixel along each axis (decimated detection)
+#ifndef SAMPLE_SCALE
+#define SAMPLE_SCALE 1
+#endif
+#ifndef BLUR_FILTER
+#define BLUR_FILTER 0
+#endif
+#ifndef BLUR_MODE
+#define BLUR_MODE BLUR_GAUSSIAN
+#endif
+// luma is quantized to shades levels
+#ifndef QUANTIZE
+#define QUANTIZE 0
+#endif
+// snorm image is only needed for debug view
+#ifndef BINARY_IMAGE
+#define BINARY_IMAGE 0
+#endif
+
+layout (local_size_x=TILE, local_size_y=TILE, local_size_z=1) in;
+
+// camera image (rgba8) or decoded luma (r8)
+uniform sampler2D imageIn;
+layout (r8_snorm, binding=1) writeonly uniform image2D imageOut;
+// 32 pixels per texel, bit x set if pixel x is white
+layout (r32ui,    binding=2) writeonly uniform uimage2D imagePacked;
+
+uniform int shades;
+uniform float blurRadius;
+uniform float blurQuality;
+uniform float blurDirections;
+// separable gaussian, gaussWeights[i] for offset +-i
+uniform int gaussRadius;
+uniform float gaussWeights[HALO + 1];
+uniform float threshold;
+// first pixel of processed region (tracking ROI), multiple of 32
+uniform ivec2 roiOrigin;
+
+#if BLUR_FILTER
+// luma in output orientation, pixels outside the image repeat the edge
+// (clamp to edge like blur.comp.glsl and the CPU path)
+shared float tile[CACHE][CACHE];
+#if BLUR_MODE == BLUR_GAUSSIAN
+// tile rows after horizontal gaussian pass
+shared float rows[CACHE][TILE];
+#endif
+#endif
+// one word per group row
+shared uint packedRows[TILE];
+
+// raw camera formats already carry luma in alpha, decoded MJPG luma in red
+// https://en.wikipedia.org/wiki/Luma_(video)
+float loadLuma(ivec2 uv)
+{
+    vec4 color = texelFetch(imageIn, uv, 0);
+#if LUMA_LAYOUT == LUMA_ALPHA
+    return color.a;
+#elif LUMA_LAYOUT == LUMA_RED
+    return color.r;
+#else
+    return dot(color.rgb, vec3(0.299, 0.587, 0.114));
+#endif
+}
+
+#if BLUR_FILTER && BLUR_MODE == BLUR_DIRECTIONAL
+
+// same sampling pattern as grayscale.comp.glsl, read from tile cache
+// (luma is linear, so blurring luma equals luma of blurred color)
+// taps outside the image are skipped like there, origin is image position of tile[0][0]
+float blur(float luma, ivec2 local, ivec2 origin, ivec2 size)
+{
+    float counts = 0.0;
+    float invQuality = 1.0 / blurQuality;
+    float radius = min(blurRadius, float(HALO));
+    for(float d = 0.0; d < PI_2; d += PI_2 / blurDirections)
+    {
+        for(float i = invQuality; i <= 1.0; i += invQuality)
+        {
+            ivec2 uv = ivec2(vec2(cos(d), sin(d)) * radius * i) + local;
+            ivec2 pixel = origin + uv;
+            if(all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, size)))
+            {
+                luma += tile[uv.y][uv.x];
+                counts += 1.0;
+            }
+        }
+    }
+    return luma / counts;
+}
+#endif
+
+#if BLUR_FILTER && BLUR_MODE == BLUR_GAUSSIAN
+
+// horizontal pass over every cached row, whole group takes part
+void gaussRows()
+{
+    for(int i = int(gl_LocalInvocationIndex); i < CACHE * TILE; i += TILE * TILE)
+    {
+        int row = i / TILE, col = i % TILE;
+        float sum = 0.0;
+        for(int k = -gaussRadius; k <= gaussRadius; k++)
+            sum += tile[row][col + HALO + k] * gaussWeights[abs(k)];
+        rows[row][col] = sum;
+    }
+}
+
+// vertical pass for one pixel from row cache
+// (weights are normalized, edges are clamped in the tile)
+float gaussColumn(ivec2 local)
+{
+    float sum = 0.0;
+    for(int k = -gaussRadius; k <= gaussRadius; k++)
+        sum += rows[local.y + HALO + k][local.x] * gaussWeights[abs(k)];
+    return sum;
+}
+#endif
+
+// luma of output pixel, averaged over the capture block it covers
+// camera image is stored top-down, output starts from bottom left
+float sampleLuma(ivec2 uv)
+{
+    ivec2 bounds = textureSize(imageIn, 0) - ivec2(1);
+    ivec2 origin = ivec2(uv.x * SAMPLE_SCALE, bounds.y - uv.y * SAMPLE_SCALE);
+#if SAMPLE_SCALE > 1
+    float sum = 0.0;
+    for(int j = 0; j < SAMPLE_SCALE; j++)
+        for(int i = 0; i < SAMPLE_SCALE; i++)
+            sum += loadLuma(clamp(origin + ivec2(i, -j), ivec2(0), bounds));
+    return sum / float(SAMPLE_SCALE * SAMPLE_SCALE);
+#else
+    return loadLuma(origin);
+#endif
+}
+
+float quantize(float luma, int n)
+{
+#if QUANTIZE
+    float convert = 1.0 / (n - 1.0);
+    luma = floor(luma / convert + 0.5) * convert;
+#endif
+    return luma;
+}
+
+void main()
+{
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy) + roiOrigin;
+    ivec2 size = imageSize(imageOut);
+    // no early return, every thread has to reach the packing barrier
+    bool inside = all(lessThan(baseUV, size));
+    if(gl_LocalInvocationID.x == 0) packedRows[gl_LocalInvocationID.y] = 0u;
+    float luma = 0.0;
+#if BLUR_FILTER
+    // whole group cooperatively loads tile and halo once
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE + roiOrigin - ivec2(HALO);
+    for(int i = int(gl_LocalInvocationIndex); i < CACHE * CACHE; i += TILE * TILE)
+    {
+        ivec2 cell = ivec2(i % CACHE, i / CACHE);
+        tile[cell.y][cell.x] = sampleLuma(clamp(origin + cell, ivec2(0), size - ivec2(1)));
+    }
+    barrier();
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+#if BLUR_MODE == BLUR_GAUSSIAN
+    gaussRows();
+    barrier();
+    if(inside) luma = gaussColumn(local);
+#else
+    if(inside) luma = blur(tile[local.y + HALO][local.x + HALO], local + ivec2(HALO), origin, size);
+#endif
+#else
+    // packed rows are cleared
+    barrier();
+    if(inside) luma = sampleLuma(baseUV);
+#endif
+    if(inside)
+    {
+        // snorm output: white -> 1, black -> -1
+        float binary = sign(quantize(luma, shades) - threshold);
+#if BINARY_IMAGE
+        imageStore(imageOut, baseUV, vec4(binary));
+#endif
+        if(binary > 0.0) atomicOr(packedRows[gl_LocalInvocationID.y], 1u << gl_LocalInvocationID.x);
+    }
+    barrier();
+    if(gl_LocalInvocationID.x == 0 && inside)
+        imageStore(imagePacked, ivec2(baseUV.x >> 5, baseUV.y), uvec4(packedRows[gl_LocalInvocationID.y]));
+}
@@ -1,5 +1,10 @@
 #version 450 core
 
+// marker images start from bottom left, camera frames are flipped
+#ifndef DEBUG
+#define DEBUG 0
+#endif
+
 layout (location = 0) in vec2 inPos;
 layout (location = 0) out vec2 imgUV;
 
@@ -9,6 +14,10 @@ uniform float ratio_win;
 void main()
 {
     imgUV = (inPos + 1.0) * 0.5;
+#if !DEBUG
+    // camera frames are uploaded top-down
+    imgUV.y = 1.0 - imgUV.y;
+#endif
     vec2 pos = inPos;
     if(ratio_img > ratio_win)
     {
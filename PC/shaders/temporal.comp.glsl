@@ -0,0 +1,37 @@
+// this shader denoise an image by accumulating frames over time
+// static pixels are blended with history, moving pixels follow the new frame
+#version 450 core
+
+layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
+
+layout (rgba8, binding=0) readonly  uniform image2D imageIn;
+layout (rgba8, binding=1) readonly  uniform image2D imageHistory;
+layout (rgba8, binding=2) writeonly uniform image2D imageOut;
+
+// weight of new frame for static pixels (lower is smoother)
+uniform float blend;
+// color difference treated as motion
+uniform float motionThreshold;
+
+void main()
+{
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(imageIn);
+    if(baseUV.x >= size.x || baseUV.y >= size.y) return;
+    // motion from 3x3 means, single pixel noise should not count as motion
+    vec4 meanIn = vec4(0.0), meanHistory = vec4(0.0);
+    for(int dy = -1; dy <= 1; dy++)
+    {
+        for(int dx = -1; dx <= 1; dx++)
+        {
+            ivec2 uv = clamp(baseUV + ivec2(dx, dy), ivec2(0), size - ivec2(1));
+            meanIn += imageLoad(imageIn, uv);
+            meanHistory += imageLoad(imageHistory, uv);
+        }
+    }
+    float diff = length((meanIn - meanHistory).rgb) / 9.0;
+    float motion = smoothstep(0.5 * motionThreshold, motionThreshold, diff);
+    vec4 current = imageLoad(imageIn, baseUV);
+    vec4 history = imageLoad(imageHistory, baseUV);
+    imageStore(imageOut, baseUV, mix(history, current, mix(blend, 1.0, motion)));
+}
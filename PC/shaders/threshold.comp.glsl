@@ -1,18 +1,73 @@
 // this shader converts grayscale image to binary image by thresholding
 #version 450 core
 
+// snorm image is only needed for debug view (variant define)
+#ifndef BINARY_IMAGE
+#define BINARY_IMAGE 0
+#endif
+
 layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
 
-layout (r32f, binding=0) readonly  uniform image2D imageIn;
-layout (r32f, binding=1) writeonly uniform image2D imageOut;
+layout (r8,       binding=0) readonly  uniform image2D imageIn;
+layout (r8_snorm, binding=1) writeonly uniform image2D imageOut;
+// 32 pixels per texel, bit x set if pixel x is white (read back for contour tracing)
+layout (r32ui,    binding=2) writeonly uniform uimage2D imagePacked;
 
 uniform float threshold;
+// first pixel of processed region (tracking ROI), multiple of 32
+uniform ivec2 roiOrigin;
+// global mean: threshold from sum written by mean.comp.glsl, no CPU round trip
+uniform bool globalMean;
+// pixels summed, whole image or ROI
+uniform int meanPixels;
+layout (std430, binding=0) readonly buffer LumaSum
+{
+    uint lumaSum;
+};
+// Otsu: level picked by otsu.comp.glsl
+uniform bool otsu;
+layout (std430, binding=1) readonly buffer Histogram
+{
+    uint bins[256];
+    float otsuLevel;
+};
+// local threshold: tile means interpolated between tile centers, minus offset
+uniform bool adaptive;
+uniform sampler2D means;
+uniform int tileSize;
+uniform float offset;
+
+// one word per group row
+shared uint packedRows[32];
 
 void main()
 {
-    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy);
-    baseUV = clamp(baseUV, ivec2(0), imageSize(imageIn) - ivec2(1));
-    float imgColor = imageLoad(imageIn, baseUV).r;
-    imgColor = sign(imgColor - threshold);
-    imageStore(imageOut, baseUV, vec4(imgColor));
-}
\ No newline at end of file
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy) + roiOrigin;
+    ivec2 size = imageSize(imageIn);
+    bool inside = all(lessThan(baseUV, size));
+    if(gl_LocalInvocationID.x == 0) packedRows[gl_LocalInvocationID.y] = 0u;
+    barrier();
+    if(inside)
+    {
+        float imgColor = imageLoad(imageIn, baseUV).r;
+        float level = threshold;
+        if(globalMean)
+            level = float(lumaSum) / (255.0 * float(meanPixels));
+        if(otsu) level = otsuLevel;
+        if(adaptive)
+        {
+            // texel centers of means lie on tile centers
+            vec2 uv = (vec2(baseUV) + 0.5) / (float(tileSize) * vec2(textureSize(means, 0)));
+            level = texture(means, uv).r - offset;
+        }
+        // snorm output: white -> 1, black -> -1
+        imgColor = sign(imgColor - level);
+#if BINARY_IMAGE
+        imageStore(imageOut, baseUV, vec4(imgColor));
+#endif
+        if(imgColor > 0.0) atomicOr(packedRows[gl_LocalInvocationID.y], 1u << gl_LocalInvocationID.x);
+    }
+    barrier();
+    if(gl_LocalInvocationID.x == 0 && inside)
+        imageStore(imagePacked, ivec2(baseUV.x >> 5, baseUV.y), uvec4(packedRows[gl_LocalInvocationID.y]));
+}
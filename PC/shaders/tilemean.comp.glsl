@@ -0,0 +1,48 @@
+// this shader computes the mean luma of each tile for adaptive thresholding
+// one group per tile, every thread sums a strided subset, then tree reduction
+#version 450 core
+
+#define GROUP 16
+
+layout (local_size_x=GROUP, local_size_y=GROUP, local_size_z=1) in;
+
+layout (r8,  binding=0) readonly  uniform image2D imageIn;
+layout (r16f, binding=1) writeonly uniform image2D imageOut;
+
+// tile edge in pixels, multiple of GROUP
+uniform int tileSize;
+
+shared float sums[GROUP * GROUP];
+shared float counts[GROUP * GROUP];
+
+void main()
+{
+    ivec2 size = imageSize(imageIn);
+    ivec2 origin = ivec2(gl_WorkGroupID.xy) * tileSize;
+    ivec2 end = min(origin + ivec2(tileSize), size);
+    float sum = 0.0, count = 0.0;
+    // neighbouring threads read neighbouring pixels
+    for(int y = origin.y + int(gl_LocalInvocationID.y); y < end.y; y += GROUP)
+    {
+        for(int x = origin.x + int(gl_LocalInvocationID.x); x < end.x; x += GROUP)
+        {
+            sum += imageLoad(imageIn, ivec2(x, y)).r;
+            count += 1.0;
+        }
+    }
+    uint index = gl_LocalInvocationIndex;
+    sums[index] = sum;
+    counts[index] = count;
+    barrier();
+    for(uint stride = GROUP * GROUP / 2; stride > 0; stride >>= 1)
+    {
+        if(index < stride)
+        {
+            sums[index] += sums[index + stride];
+            counts[index] += counts[index + stride];
+        }
+        barrier();
+    }
+    if(index == 0)
+        imageStore(imageOut, ivec2(gl_WorkGroupID.xy), vec4(sums[0] / max(counts[0], 1.0)));
+}
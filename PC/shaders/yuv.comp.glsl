@@ -0,0 +1,52 @@
+// this shader converts raw YUYV / NV12 camera frames to rgb
+// luma is kept in alpha channel so marker detection can skip color math
+#version 450 core
+
+#define FORMAT_YUYV 1
+#define FORMAT_NV12 2
+
+// source format is fixed per camera (variant define)
+#ifndef FORMAT
+#define FORMAT FORMAT_YUYV
+#endif
+
+layout (local_size_x=32, local_size_y=32, local_size_z=1) in;
+
+// YUYV: rgba8 texel = (Y0, U, Y1, V) covering 2 pixels
+// NV12: r8, Y plane rows followed by interleaved UV rows
+uniform sampler2D rawImage;
+layout (rgba8, binding=0) writeonly uniform image2D imageOut;
+
+// BT.601 limited range
+vec3 yuv2rgb(float y, float u, float v)
+{
+    y = 1.164 * (y - 0.0625);
+    u -= 0.5;
+    v -= 0.5;
+    return clamp(vec3(
+        y + 1.596 * v,
+        y - 0.392 * u - 0.813 * v,
+        y + 2.017 * u
+    ), 0.0, 1.0);
+}
+
+void main()
+{
+    ivec2 baseUV = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(imageOut);
+    if(baseUV.x >= size.x || baseUV.y >= size.y) return;
+    float y, u, v;
+#if FORMAT == FORMAT_YUYV
+    vec4 texel = texelFetch(rawImage, ivec2(baseUV.x >> 1, baseUV.y), 0);
+    y = (baseUV.x & 1) == 0 ? texel.r : texel.b;
+    u = texel.g;
+    v = texel.a;
+#else
+    y = texelFetch(rawImage, baseUV, 0).r;
+    ivec2 uvRow = ivec2(baseUV.x & ~1, size.y + (baseUV.y >> 1));
+    u = texelFetch(rawImage, uvRow, 0).r;
+    v = texelFetch(rawImage, uvRow + ivec2(1, 0), 0).r;
+#endif
+    float luma = clamp(1.164 * (y - 0.0625), 0.0, 1.0);
+    imageStore(imageOut, baseUV, vec4(yuv2rgb(y, u, v), luma));
+}
\ No newline at end of file
@@ -7,47 +7,159 @@
 #include <stdexcept>
 #include <memory>
 #include <cmath>
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <mutex>
 #include "shader.hpp"
+#include "triplebuffer.hpp"
+#include "framesource.hpp"
+#include "session.hpp"
+#include "latency.hpp"
+
+#define CAMERA_FIRST_FRAME_TIMEOUT 5.0
+// one upload buffer region per triple buffer slot
+#define CAMERA_PBO_COUNT 3
+#define CAMERA_FENCE_TIMEOUT 2000000 // 2ms in nanoseconds, longest wait for an upload before skipping the frame
+// upload target, denoise output and history for temporal denoise
+#define CAMERA_TEX_COUNT 3
+// match HALO and LUT_SIZE in denoise.comp.glsl
+#define DENOISE_MAX_RADIUS 8
+#define DENOISE_LUT_SIZE 64
+
+enum class DenoiseMode
+{
+    // bilateral filter within the frame
+    Spatial = 0,
+    // motion-aware accumulation with previous output
+    Temporal = 1,
+};
+
+// frame handed from capture thread to GL thread
+struct CameraFrame
+{
+    // normally a header on staging, sources may hand out their own buffer instead
+    cv::Mat image;
+    // mapped upload buffer region owned by this slot and its offset in the buffer
+    cv::Mat staging;
+    size_t offset = 0;
+    // GL thread only: upload from staging still in flight
+    GLsync fence = nullptr;
+    // sequence number, gaps are frames dropped by the triple buffer
+    uint64_t id = 0;
+    FrameTiming::Clock::time_point captured;
+};
 
 class Camera
 {
 public:
-    Camera()
-    {
-        int cameraId, cameraAPI;
-        getValidSecondaryCamera(cameraId, cameraAPI);
-        // try to open camera
-        // first try directshow for Windows
-        // next try V4L2 for Linux
-        // finally autodetect
-        if(!_cam.open(cameraId, cameraAPI))
-            throw std::runtime_error("Failed to open camera!");
-        _backend = _cam.getBackendName();
-        // set properties
-        _cam.set(cv::CAP_PROP_FPS, 30.0);
-        _cam.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'));
-        _cam.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
-        _width = static_cast<int>(_cam.get(cv::CAP_PROP_FRAME_WIDTH));
-        _height = static_cast<int>(_cam.get(cv::CAP_PROP_FRAME_HEIGHT));
+    // detectScale (1, 2, 4) reduces detection image size, corners are refined on the full frame
+    Camera(std::shared_ptr<FrameSource> source, int detectScale = 1) : _source(source),
+        _capture_running(false), _capture_done(false), _frames_captured(0),
+        _color_interval(1), _recording(false), _frames_recorded(0)
+    {
+        _width = _source->width();
+        _height = _source->height();
+        if(_width <= 0 || _height <= 0)
+            throw std::runtime_error("Invalid frame size from " + _source->name());
         _ratio = static_cast<float>(_width) / _height;
         _groupX = static_cast<int>(std::ceil(_width / 32.0f));
         _groupY = static_cast<int>(std::ceil(_height / 32.0f));
+        _format = _source->format();
+        // detection image, MJPG luma is decoded at reduced DCT scale,
+        // other formats are box-filtered down while computing luma
+        _luma_scale = detectScale;
+        if(_luma_scale != 1 && _luma_scale != 2 && _luma_scale != 4)
+            throw std::runtime_error("Detection scale has to be 1, 2 or 4!");
+        _detect_width = (_width + _luma_scale - 1) / _luma_scale;
+        _detect_height = (_height + _luma_scale - 1) / _luma_scale;
         // init opengl texture
-        glGenTextures(2, _tex);
-        for(int i = 0; i < 2; i++)
+        glGenTextures(CAMERA_TEX_COUNT, _tex);
+        for(int i = 0; i < CAMERA_TEX_COUNT; i++)
         {
             glBindTexture(GL_TEXTURE_2D, _tex[i]);
-            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, _width, _height);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, _width, _height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        // init persistently mapped PBO, every triple buffer slot owns a region of it
+        // (MJPG color slots too), capture threads read and decode straight into it
+        // and the GL thread only starts the async texture upload,
+        // readable because detection, recording and the CPU path use the frame in place
+        _frame_bytes = frameBytes(_format, _width, _height);
+        int regions = _format == PixelFormat::JPEG ? 2 * CAMERA_PBO_COUNT : CAMERA_PBO_COUNT;
+        const GLbitfield pboFlags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &_pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _frame_bytes * regions, nullptr, pboFlags | GL_CLIENT_STORAGE_BIT);
+        _pbo_ptr = static_cast<uint8_t*>(glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER, 0, _frame_bytes * regions, pboFlags));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if(!_pbo_ptr)
+            throw std::runtime_error("Failed to map pixel buffer!");
+        for(int i = 0; i < CAMERA_PBO_COUNT; i++)
+        {
+            switch(_format)
+            {
+                case PixelFormat::JPEG:
+                    mapFrame(_frames.slot(i), i, _detect_height, _detect_width, CV_8UC1);
+                    mapFrame(_colors.slot(i), CAMERA_PBO_COUNT + i, _height, _width, CV_8UC3);
+                    break;
+                case PixelFormat::YUYV:
+                    mapFrame(_frames.slot(i), i, _height, _width, CV_8UC2);
+                    break;
+                case PixelFormat::NV12:
+                    mapFrame(_frames.slot(i), i, _height * 3 / 2, _width, CV_8UC1);
+                    break;
+                default:
+                    mapFrame(_frames.slot(i), i, _height, _width, CV_8UC3);
+                    break;
+            }
+        }
+        // raw frames are uploaded packed and converted by a compute pass
+        if(_format == PixelFormat::YUYV || _format == PixelFormat::NV12)
+        {
+            glGenTextures(1, &_tex_raw);
+            glBindTexture(GL_TEXTURE_2D, _tex_raw);
+            if(_format == PixelFormat::YUYV)
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, _width / 2, _height);
+            else
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, _width, _height * 3 / 2);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            _yuv_shader = ShaderCache::compute("shaders/yuv.comp.glsl",
+                {{"FORMAT", std::to_string(static_cast<int>(_format))}});
+        }
+        // luma decoded from MJPG feeds detection directly
+        if(_format == PixelFormat::JPEG)
+        {
+            glGenTextures(1, &_tex_luma);
+            glBindTexture(GL_TEXTURE_2D, _tex_luma);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, _detect_width, _detect_height);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
             glBindTexture(GL_TEXTURE_2D, 0);
         }
-        // try to get first frame
-        if(!update())
+        // start capture thread and wait for first frame
+        _capture_running = true;
+        _capture_thread = std::thread(&Camera::captureLoop, this);
+        if(_format == PixelFormat::JPEG)
+            _color_thread = std::thread(&Camera::colorLoop, this);
+        if(!waitFirstFrame())
+        {
+            stopCapture();
             throw std::runtime_error("Failed to get frame from camera!");
+        }
         // init VAO
         const float vertices[] = {
             -1.0f, -1.0f,
@@ -65,9 +177,8 @@ public:
         glEnableVertexAttribArray(0);
         glBindVertexArray(0);
         // prepare denoise shader
-        _denoise_shader = std::make_shared<Shader>();
-        _denoise_shader->add("shaders/denoise.comp.glsl", GL_COMPUTE_SHADER);
-        _denoise_shader->compile();
+        _denoise_shader = ShaderCache::compute("shaders/denoise.comp.glsl");
+        _temporal_shader = ShaderCache::compute("shaders/temporal.comp.glsl");
         // set camera calibration matrix
         loadCameraData();
         // create projection matrix
@@ -80,27 +191,114 @@ public:
 
     ~Camera()
     {
-        _cam.release();
-        glDeleteTextures(2, _tex);
+        stopCapture();
+        stopRecording();
+        for(int i = 0; i < CAMERA_PBO_COUNT; i++)
+        {
+            if(_frames.slot(i).fence) glDeleteSync(_frames.slot(i).fence);
+            if(_colors.slot(i).fence) glDeleteSync(_colors.slot(i).fence);
+        }
+        glUnmapNamedBuffer(_pbo);
+        glDeleteBuffers(1, &_pbo);
+        if(_tex_raw) glDeleteTextures(1, &_tex_raw);
+        if(_tex_luma) glDeleteTextures(1, &_tex_luma);
+        glDeleteTextures(CAMERA_TEX_COUNT, _tex);
         glDeleteVertexArrays(1, &_vao);
     }
 
+    // pick up newest frame from capture thread, older ones are dropped
+    // return false if no new frame arrived since last call
     bool update()
     {
-        bool updated = _cam.read(_frame);
+        // consume hands the old front slot back to capture thread, upload from it has to be done
+        bool updated = _frames.pending() && release(_frames.front()) && _frames.consume();
+        CameraFrame& frame = _frames.front();
         // if updated, update texture pixels
         if(updated)
         {
-            cv::flip(_frame, _frame, 0);
-            // cv::fastNlMeansDenoisingColored(_frame, _frame);
-            glBindTexture(GL_TEXTURE_2D, fetchTex());
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, GL_BGR, GL_UNSIGNED_BYTE, _frame.data);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            if(_denoise) denoise();
+            // cv::fastNlMeansDenoisingColored(frame, frame);
+            if(_format == PixelFormat::JPEG)
+                upload(frame, _tex_luma, PixelFormat::GRAY);
+            else
+            {
+                GLuint history = lastTex();
+                upload(frame, fetchTex(), _format);
+                if(_denoise) denoise(history);
+            }
+            _frames_used++;
+            // timing of the frame now on GPU, carried on by whoever processes it
+            _timing = FrameTiming();
+            _timing.id = frame.id;
+            _timing.stamp(LatencyStage::Capture, frame.captured);
+            _timing.stamp(LatencyStage::Upload);
+        }
+        // color for display is decoded lazily on its own thread
+        if(_format == PixelFormat::JPEG && _colors.pending() && release(_colors.front()) && _colors.consume())
+        {
+            GLuint history = lastTex();
+            upload(_colors.front(), fetchTex(), PixelFormat::BGR);
+            if(_denoise) denoise(history);
         }
         return updated;
     }
 
+    // wait until GPU finished uploading from the frame's region,
+    // bounded so a stalled GPU keeps the last frame instead of blocking the render thread
+    bool release(CameraFrame& frame)
+    {
+        if(!frame.fence) return true;
+        GLenum status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, CAMERA_FENCE_TIMEOUT);
+        if(status == GL_WAIT_FAILED)
+            throw std::runtime_error("Failed to wait for frame upload buffer!");
+        if(status == GL_TIMEOUT_EXPIRED) return false;
+        glDeleteSync(frame.fence);
+        frame.fence = nullptr;
+        return true;
+    }
+
+    // start async texture upload from the frame's PBO region, no copy on this thread
+    // frame stays top-down in memory, vertical flip happens when sampling
+    void upload(CameraFrame& frame, GLuint tex, PixelFormat format)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        void* pixels = reinterpret_cast<void*>(frame.offset);
+        switch(format)
+        {
+            case PixelFormat::GRAY:
+                glTextureSubImage2D(tex, 0, 0, 0, frame.image.cols, frame.image.rows, GL_RED, GL_UNSIGNED_BYTE, pixels);
+                break;
+            case PixelFormat::YUYV:
+                glTextureSubImage2D(_tex_raw, 0, 0, 0, _width / 2, _height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                break;
+            case PixelFormat::NV12:
+                glTextureSubImage2D(_tex_raw, 0, 0, 0, _width, _height * 3 / 2, GL_RED, GL_UNSIGNED_BYTE, pixels);
+                break;
+            default:
+                glTextureSubImage2D(tex, 0, 0, 0, _width, _height, GL_BGR, GL_UNSIGNED_BYTE, pixels);
+                break;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if(format == PixelFormat::YUYV || format == PixelFormat::NV12) convertYUV(tex);
+    }
+
+    // convert packed raw frame to rgb + luma (alpha)
+    void convertYUV(GLuint tex)
+    {
+        glUseProgram(_yuv_shader->program());
+        glBindTextureUnit(0, _tex_raw);
+        glBindImageTexture(0, tex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        _yuv_shader->uniformInt("rawImage", 0);
+        glDispatchCompute(
+            static_cast<GLuint>(_groupX),
+            static_cast<GLuint>(_groupY), 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        glBindTextureUnit(0, 0);
+        glUseProgram(0);
+    }
+
     void draw()
     {
         glBindVertexArray(_vao);
@@ -108,15 +306,40 @@ public:
         glBindVertexArray(0);
     }
 
-    void denoise()
+    // history is the previous output, used by temporal mode
+    void denoise(GLuint history)
     {
+        if(_denoise_mode == static_cast<int>(DenoiseMode::Temporal))
+        {
+            denoiseTemporal(history);
+            return;
+        }
+        updateDenoiseWeights();
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
         glUseProgram(_denoise_shader->program());
-        glBindImageTexture(0, lastTex(),  0, GL_FALSE, 0, GL_READ_ONLY,  GL_RGBA32F);
-        glBindImageTexture(1, fetchTex(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-        _denoise_shader->uniformFloat("coeff_sigma", _sigma);
-        _denoise_shader->uniformFloat("coeff_kSigma", _kSigma);
-        _denoise_shader->uniformFloat("coeff_threshold", _threshold);
+        glBindImageTexture(0, lastTex(),  0, GL_FALSE, 0, GL_READ_ONLY,  GL_RGBA8);
+        glBindImageTexture(1, fetchTex(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        _denoise_shader->uniformInt("radius", _denoise_radius);
+        _denoise_shader->uniformFloatArray("spatialWeights", _denoise_spatial,
+            (DENOISE_MAX_RADIUS + 1) * (DENOISE_MAX_RADIUS + 1));
+        _denoise_shader->uniformFloatArray("rangeWeights", _denoise_range, DENOISE_LUT_SIZE);
+        _denoise_shader->uniformFloat("rangeScale", _denoise_range_scale);
+        glDispatchCompute(
+            static_cast<GLuint>(_groupX),
+            static_cast<GLuint>(_groupY), 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glUseProgram(0);
+    }
+
+    void denoiseTemporal(GLuint history)
+    {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glUseProgram(_temporal_shader->program());
+        glBindImageTexture(0, lastTex(),  0, GL_FALSE, 0, GL_READ_ONLY,  GL_RGBA8);
+        glBindImageTexture(1, history,    0, GL_FALSE, 0, GL_READ_ONLY,  GL_RGBA8);
+        glBindImageTexture(2, fetchTex(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        _temporal_shader->uniformFloat("blend", _temporal_blend);
+        _temporal_shader->uniformFloat("motionThreshold", _temporal_motion);
         glDispatchCompute(
             static_cast<GLuint>(_groupX),
             static_cast<GLuint>(_groupY), 1);
@@ -124,15 +347,107 @@ public:
         glUseProgram(0);
     }
 
+    // rebuild weight tables when parameters change
+    void updateDenoiseWeights()
+    {
+        if(_sigma == _denoise_params.x && _kSigma == _denoise_params.y && _threshold == _denoise_params.z)
+            return;
+        _denoise_params = glm::vec3(_sigma, _kSigma, _threshold);
+        // radius is limited by shared memory halo
+        float radius = std::min(std::round(_kSigma * _sigma), static_cast<float>(DENOISE_MAX_RADIUS));
+        _denoise_radius = static_cast<int>(radius);
+        // normalization constants cancel out in the weighted average
+        for(int dy = 0; dy <= DENOISE_MAX_RADIUS; dy++)
+            for(int dx = 0; dx <= DENOISE_MAX_RADIUS; dx++)
+            {
+                float d2 = static_cast<float>(dx * dx + dy * dy);
+                _denoise_spatial[dy * (DENOISE_MAX_RADIUS + 1) + dx] =
+                    d2 <= radius * radius ? std::exp(-d2 / (2.0f * _sigma * _sigma)) : 0.0f;
+            }
+        // table covers weights down to exp(-9), beyond that pixels are ignored
+        float rangeMax = 18.0f * _threshold * _threshold;
+        _denoise_range_scale = (DENOISE_LUT_SIZE - 1) / rangeMax;
+        for(int i = 0; i < DENOISE_LUT_SIZE - 1; i++)
+            _denoise_range[i] = std::exp(-(i / _denoise_range_scale) / (2.0f * _threshold * _threshold));
+        _denoise_range[DENOISE_LUT_SIZE - 1] = 0.0f;
+    }
+
     // fetch texture and update index
+    // ring keeps last output intact while the next frame is uploaded and filtered
     GLuint fetchTex()
     {
         GLuint tex = _tex[_currentTex];
-        _currentTex = !_currentTex;
+        _currentTex = (_currentTex + 1) % CAMERA_TEX_COUNT;
         return tex;
     }
     // only get current texture
-    GLuint lastTex() {return _tex[!_currentTex];}
+    GLuint lastTex() {return _tex[(_currentTex + CAMERA_TEX_COUNT - 1) % CAMERA_TEX_COUNT];}
+    // source ran out of frames and last one was consumed
+    bool finished() {return _capture_done && !_frames.pending();}
+    std::string sourceName() const {return _source->name();}
+    // capture and upload time of the frame last returned by update()
+    const FrameTiming& timing() const {return _timing;}
+    // record frames as delivered by source into a session file
+    // compress stores BGR frames as JPEG, other formats are kept as they are
+    void startRecording(const std::string& path, bool compress)
+    {
+        std::shared_ptr<SessionWriter> recorder = std::make_shared<SessionWriter>(
+            path, _format, _width, _height, compress);
+        std::lock_guard<std::mutex> lock(_record_mutex);
+        _recorder = recorder;
+        _record_start = std::chrono::steady_clock::now();
+        _frames_recorded = 0;
+        _recording = true;
+    }
+    void stopRecording()
+    {
+        std::shared_ptr<SessionWriter> recorder;
+        {
+            std::lock_guard<std::mutex> lock(_record_mutex);
+            recorder.swap(_recorder);
+            _recording = false;
+        }
+        // index is written outside the lock, capture thread keeps going
+        if(recorder) recorder->close();
+    }
+    bool recording() const {return _recording;}
+    PixelFormat format() const {return _format;}
+    // image for marker detection and where it keeps luma
+    // MJPG sources decode luma only (maybe at reduced size),
+    // raw formats store luma in alpha channel of camera texture
+    GLuint detectTex() {return _format == PixelFormat::JPEG ? _tex_luma : lastTex();}
+    // frame last returned by update() as delivered by source,
+    // valid until next update() (GL thread only)
+    const cv::Mat& frame() {return _frames.front().image;}
+    // full resolution image of the frame last returned by update() for corner refinement,
+    // MJPG: decoded color frame if color thread already finished that frame, else empty
+    const cv::Mat& refineFrame()
+    {
+        static const cv::Mat none;
+        if(_format != PixelFormat::JPEG) return frame();
+        const CameraFrame& color = _colors.front();
+        return color.id == _frames.front().id ? color.image : none;
+    }
+    PixelFormat refineFormat() const {return _format == PixelFormat::JPEG ? PixelFormat::BGR : _format;}
+    LumaLayout detectLuma() const
+    {
+        switch(_format)
+        {
+            case PixelFormat::JPEG: return LumaLayout::Red;
+            case PixelFormat::YUYV:
+            case PixelFormat::NV12: return LumaLayout::Alpha;
+            default:                return LumaLayout::RGB;
+        }
+    }
+    int detectWidth() const {return _detect_width;}
+    int detectHeight() const {return _detect_height;}
+    int detectGroupX() const {return static_cast<int>(std::ceil(_detect_width / 32.0f));}
+    int detectGroupY() const {return static_cast<int>(std::ceil(_detect_height / 32.0f));}
+    // capture pixels per detection pixel
+    float detectScale() const {return static_cast<float>(_luma_scale);}
+    // capture pixels averaged per detection pixel by preprocessing shaders
+    // (reduced MJPG luma is already at detection size)
+    int detectSample() const {return _format == PixelFormat::JPEG ? 1 : _luma_scale;}
     GLuint vao() const {return _vao;}
     int width() const {return _width;}
     int height() const {return _height;}
@@ -150,14 +465,53 @@ public:
 private:
     int _width, _height, _groupX, _groupY;
     float _ratio;
-    cv::VideoCapture _cam;
-    cv::Mat _frame;
-    GLuint _tex[2], _vao;
+    std::shared_ptr<FrameSource> _source;
+    // frames decoded by capture thread
+    TripleBuffer<CameraFrame> _frames;
+    FrameTiming _timing;
+    std::thread _capture_thread;
+    std::atomic<bool> _capture_running;
+    std::atomic<bool> _capture_done;
+    std::atomic<unsigned> _frames_captured;
+    unsigned _frames_used = 0;
+    GLuint _tex[CAMERA_TEX_COUNT], _vao;
     int _currentTex = 0;
+    // raw frame before color conversion
+    PixelFormat _format;
+    GLuint _tex_raw = 0;
+    // luma decoded from MJPG for detection, color decoded lazily for display
+    int _luma_scale, _detect_width, _detect_height;
+    GLuint _tex_luma = 0;
+    // tagged with id of the luma frame, color may lag behind detection
+    TripleBuffer<CameraFrame> _jpegs;
+    TripleBuffer<CameraFrame> _colors;
+    std::thread _color_thread;
+    std::atomic<int> _color_interval;
+    // session recording, written by capture thread
+    std::mutex _record_mutex;
+    std::shared_ptr<SessionWriter> _recorder;
+    std::chrono::steady_clock::time_point _record_start;
+    std::atomic<bool> _recording;
+    std::atomic<unsigned> _frames_recorded;
+    char _record_path[256] = "session.mrk";
+    bool _record_compress = false;
+    std::shared_ptr<Shader> _yuv_shader;
+    // upload buffer, one region per frame slot
+    GLuint _pbo;
+    uint8_t* _pbo_ptr = nullptr;
+    size_t _frame_bytes;
     std::shared_ptr<Shader> _denoise_shader;
+    std::shared_ptr<Shader> _temporal_shader;
     bool _denoise = false;
-    float _sigma = 3.0f, _kSigma = 6.0f, _threshold = 0.1f;
-    std::string _backend;
+    int _denoise_mode = static_cast<int>(DenoiseMode::Spatial);
+    float _temporal_blend = 0.25f, _temporal_motion = 0.08f;
+    float _sigma = 2.0f, _kSigma = 3.0f, _threshold = 0.1f;
+    // weight tables of current parameters (sigma, kSigma, threshold)
+    glm::vec3 _denoise_params = glm::vec3(0.0f);
+    int _denoise_radius = 0;
+    float _denoise_spatial[(DENOISE_MAX_RADIUS + 1) * (DENOISE_MAX_RADIUS + 1)];
+    float _denoise_range[DENOISE_LUT_SIZE];
+    float _denoise_range_scale = 0.0f;
     glm::mat3 _camK;
     glm::mat3 _camInvK;
     glm::vec3 _camDistCoeffK;
@@ -165,5 +519,34 @@ private:
     glm::mat4 _camProj;
 
     void loadCameraData();
-    void getValidSecondaryCamera(int& cameraId, int& apiPreference);
+    void captureLoop();
+    void record(const cv::Mat& frame, FrameTiming::Clock::time_point captured);
+    void colorLoop();
+    bool waitFirstFrame();
+    // point slot at a region of the upload buffer
+    void mapFrame(CameraFrame& frame, int region, int rows, int cols, int type)
+    {
+        frame.offset = _frame_bytes * region;
+        frame.staging = cv::Mat(rows, cols, type, _pbo_ptr + frame.offset);
+        frame.image = frame.staging;
+    }
+    // capture side: bring frame into its upload region if source did not read into it,
+    // rows may be padded (e.g. shared memory stride) and get packed here,
+    // false if frame does not fit the upload layout
+    static bool stage(CameraFrame& frame)
+    {
+        if(frame.image.data == frame.staging.data) return true;
+        if(frame.image.cols != frame.staging.cols || frame.image.rows != frame.staging.rows ||
+            frame.image.type() != frame.staging.type())
+            return false;
+        frame.image.copyTo(frame.staging);
+        frame.image = frame.staging;
+        return true;
+    }
+    void stopCapture()
+    {
+        _capture_running = false;
+        if(_capture_thread.joinable()) _capture_thread.join();
+        if(_color_thread.joinable()) _color_thread.join();
+    }
 };
\ No newline at end of file
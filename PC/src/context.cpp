@@ -99,6 +99,8 @@ Context::Context(const std::string& title)
 
 Context::~Context()
 {
+    // recorder owns GL buffers
+    _recorder = nullptr;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -116,6 +118,12 @@ void Context::beginFrame()
     glfwPollEvents();
     glfwGetFramebufferSize(_window, &_winWidth, &_winHeight);
     _ratio = static_cast<float>(_winWidth) / _winHeight;
+    // sinks take one frame size only, a resized window ends the recording
+    if(_recorder && (_recorder->width() != _winWidth || _recorder->height() != _winHeight))
+    {
+        std::cout << "Window resized, stopped recording to " << _recorder->name() << std::endl;
+        _recorder = nullptr;
+    }
     glViewport(0, 0, _winWidth, _winHeight);
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -124,6 +132,7 @@ void Context::beginFrame()
 
 void Context::endFrame(std::function<void()> customUI)
 {
+    if(_recorder) _recorder->capture();
     if(_displayUI && customUI)
     {
         ImGui_ImplOpenGL3_NewFrame();
@@ -134,8 +143,22 @@ void Context::endFrame(std::function<void()> customUI)
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
     }
     glfwSwapBuffers(_window);
+    _lastSwap = std::chrono::steady_clock::now();
     // fps control
     double elapsed = glfwGetTime() - _timer;
-    if(elapsed < CONTEXT_SPF)
+    if(_limitFPS && elapsed < CONTEXT_SPF)
         std::this_thread::sleep_for(std::chrono::duration<double>(CONTEXT_SPF - elapsed));
 }
+
+void Context::startRecording(const std::string& path)
+{
+    _recorder = nullptr;
+    _recorder = std::make_shared<OutputRecorder>(
+        FrameSink::create(path, _winWidth, _winHeight, CONTEXT_FPS), _winWidth, _winHeight);
+}
+
+void Context::limitFPS(bool enabled)
+{
+    _limitFPS = enabled;
+    glfwSwapInterval(enabled ? 1 : 0);
+}
@@ -4,6 +4,9 @@
 #include <GLFW/glfw3.h>
 #include <string>
 #include <functional>
+#include <chrono>
+#include <memory>
+#include "outputrecorder.hpp"
 
 #define CONTEXT_FPS 30
 #define CONTEXT_SPF 0.03333333333
@@ -17,9 +20,19 @@ public:
     bool loop();
     void beginFrame();
     void endFrame(std::function<void()> customUI = nullptr);
+    // disable vsync and fps control for benchmarking
+    void limitFPS(bool enabled);
     float ratio() const {return _ratio;}
     int width() const {return _winWidth;}
     int height() const {return _winHeight;}
+    // record composited output (camera frame + overlay, without UI)
+    // to a video file or directory of images, at current framebuffer size
+    // (recording stops when the window is resized)
+    void startRecording(const std::string& path);
+    void stopRecording() {_recorder = nullptr;}
+    bool recording() const {return _recorder != nullptr;}
+    // when last frame was handed to the swap chain
+    std::chrono::steady_clock::time_point lastSwap() const {return _lastSwap;}
 
     void UI();
 
@@ -30,6 +43,10 @@ private:
     GLFWwindow* _window;
     bool _displayUI = true;
     double _timer = 0.0;
+    bool _limitFPS = true;
+    std::chrono::steady_clock::time_point _lastSwap;
+    std::shared_ptr<OutputRecorder> _recorder;
+    char _record_path[256] = "output.mp4";
 
     static void glfw_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
     {
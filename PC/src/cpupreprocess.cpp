@@ -0,0 +1,340 @@
+#include "cpupreprocess.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <future>
+#include <cmath>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_AVX2
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define CPU_SSSE3
+#endif
+
+// luma weights (0.114, 0.587, 0.299) in 8-bit fixed point, sum is 256
+#define LUMA_B 29
+#define LUMA_G 150
+#define LUMA_R 77
+
+#if defined(CPU_AVX2) || defined(CPU_SSSE3)
+// split 16 BGR pixels (48 bytes) into one register per channel
+static inline void deinterleaveBGR(const uint8_t* src, __m128i& b, __m128i& g, __m128i& r)
+{
+    const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+    b = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+#endif
+
+// BGR row to luma, return sum of luma for global mean
+static uint64_t grayRow(const uint8_t* src, uint8_t* dst, int width)
+{
+    uint64_t sum = 0;
+    int x = 0;
+#if defined(CPU_AVX2) || defined(CPU_SSSE3)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i b, g, r;
+        deinterleaveBGR(src + x * 3, b, g, r);
+#if defined(CPU_AVX2)
+        // 16 bit lanes do not overflow: 255 * 256 + 128 < 65536
+        __m256i y = _mm256_add_epi16(
+            _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_cvtepu8_epi16(b), _mm256_set1_epi16(LUMA_B)),
+                _mm256_mullo_epi16(_mm256_cvtepu8_epi16(g), _mm256_set1_epi16(LUMA_G))),
+            _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_cvtepu8_epi16(r), _mm256_set1_epi16(LUMA_R)),
+                _mm256_set1_epi16(128)));
+        y = _mm256_srli_epi16(y, 8);
+        __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+#else
+        __m128i lo = _mm_add_epi16(
+            _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), _mm_set1_epi16(LUMA_B)),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), _mm_set1_epi16(LUMA_G))),
+            _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), _mm_set1_epi16(LUMA_R)),
+                _mm_set1_epi16(128)));
+        __m128i hi = _mm_add_epi16(
+            _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), _mm_set1_epi16(LUMA_B)),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), _mm_set1_epi16(LUMA_G))),
+            _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), _mm_set1_epi16(LUMA_R)),
+                _mm_set1_epi16(128)));
+        __m128i packed = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+#endif
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), packed);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(packed, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+    sum = lanes[0] + lanes[1];
+#endif
+    for(; x < width; x++)
+    {
+        const uint8_t* p = src + x * 3;
+        dst[x] = static_cast<uint8_t>((p[0] * LUMA_B + p[1] * LUMA_G + p[2] * LUMA_R + 128) >> 8);
+        sum += dst[x];
+    }
+    return sum;
+}
+
+// horizontal gaussian pass, pad holds width + 2 * radius floats
+static void blurRow(const uint8_t* src, float* dst, float* pad, int width, int radius, const float* w)
+{
+    // clamp to edge, same as blur.comp.glsl
+    for(int i = 0; i < radius; i++)
+    {
+        pad[i] = src[0];
+        pad[radius + width + i] = src[width - 1];
+    }
+    for(int x = 0; x < width; x++) pad[radius + x] = src[x];
+    const float* center = pad + radius;
+    int x = 0;
+#if defined(CPU_AVX2)
+    for(; x + 8 <= width; x += 8)
+    {
+        __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(center + x), _mm256_set1_ps(w[0]));
+        for(int k = 1; k <= radius; k++)
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]),
+                _mm256_add_ps(_mm256_loadu_ps(center + x - k), _mm256_loadu_ps(center + x + k))));
+        _mm256_storeu_ps(dst + x, acc);
+    }
+#elif defined(CPU_SSSE3)
+    for(; x + 4 <= width; x += 4)
+    {
+        __m128 acc = _mm_mul_ps(_mm_loadu_ps(center + x), _mm_set1_ps(w[0]));
+        for(int k = 1; k <= radius; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]),
+                _mm_add_ps(_mm_loadu_ps(center + x - k), _mm_loadu_ps(center + x + k))));
+        _mm_storeu_ps(dst + x, acc);
+    }
+#endif
+    for(; x < width; x++)
+    {
+        float acc = center[x] * w[0];
+        for(int k = 1; k <= radius; k++)
+            acc += w[k] * (center[x - k] + center[x + k]);
+        dst[x] = acc;
+    }
+}
+
+// vertical gaussian pass, rows[radius] is the output row, rows[radius +- k] its neighbours
+static void blurColumn(const float* const* rows, float* dst, int width, int radius, const float* w)
+{
+    const float* center = rows[radius];
+    int x = 0;
+#if defined(CPU_AVX2)
+    for(; x + 8 <= width; x += 8)
+    {
+        __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(center + x), _mm256_set1_ps(w[0]));
+        for(int k = 1; k <= radius; k++)
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]),
+                _mm256_add_ps(_mm256_loadu_ps(rows[radius - k] + x), _mm256_loadu_ps(rows[radius + k] + x))));
+        _mm256_storeu_ps(dst + x, acc);
+    }
+#elif defined(CPU_SSSE3)
+    for(; x + 4 <= width; x += 4)
+    {
+        __m128 acc = _mm_mul_ps(_mm_loadu_ps(center + x), _mm_set1_ps(w[0]));
+        for(int k = 1; k <= radius; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]),
+                _mm_add_ps(_mm_loadu_ps(rows[radius - k] + x), _mm_loadu_ps(rows[radius + k] + x))));
+        _mm_storeu_ps(dst + x, acc);
+    }
+#endif
+    for(; x < width; x++)
+    {
+        float acc = center[x] * w[0];
+        for(int k = 1; k <= radius; k++)
+            acc += w[k] * (rows[radius - k][x] + rows[radius + k][x]);
+        dst[x] = acc;
+    }
+}
+
+// bit set if luma >= level (0..255), bits past width stay clear
+static void packBytes(const uint8_t* src, uint32_t* bits, int width, int level)
+{
+    int x = 0;
+#if defined(CPU_AVX2)
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(level));
+    for(; x + 32 <= width; x += 32)
+    {
+        // unsigned compare: max(v, level) == v
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x));
+        bits[x / 32] = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_max_epu8(v, limit), v)));
+    }
+#elif defined(CPU_SSSE3)
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(level));
+    for(; x + 32 <= width; x += 32)
+    {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 16));
+        uint32_t lo = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v0, limit), v0)));
+        uint32_t hi = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v1, limit), v1)));
+        bits[x / 32] = lo | (hi << 16);
+    }
+#endif
+    for(; x < width; x += 32)
+    {
+        uint32_t word = 0;
+        for(int i = 0; i < 32 && x + i < width; i++)
+            if(src[x + i] >= level) word |= 1u << i;
+        bits[x / 32] = word;
+    }
+}
+
+// bit set if value > level (>= if inclusive), bits past width stay clear
+static void packFloats(const float* src, uint32_t* bits, int width, float level, bool inclusive)
+{
+    int x = 0;
+#if defined(CPU_AVX2)
+    const __m256 limit = _mm256_set1_ps(level);
+    for(; x + 32 <= width; x += 32)
+    {
+        uint32_t word = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            __m256 v = _mm256_loadu_ps(src + x + i * 8);
+            __m256 mask = inclusive ? _mm256_cmp_ps(v, limit, _CMP_GE_OQ) : _mm256_cmp_ps(v, limit, _CMP_GT_OQ);
+            word |= static_cast<uint32_t>(_mm256_movemask_ps(mask)) << (i * 8);
+        }
+        bits[x / 32] = word;
+    }
+#elif defined(CPU_SSSE3)
+    const __m128 limit = _mm_set1_ps(level);
+    for(; x + 32 <= width; x += 32)
+    {
+        uint32_t word = 0;
+        for(int i = 0; i < 8; i++)
+        {
+            __m128 v = _mm_loadu_ps(src + x + i * 4);
+            __m128 mask = inclusive ? _mm_cmpge_ps(v, limit) : _mm_cmpgt_ps(v, limit);
+            word |= static_cast<uint32_t>(_mm_movemask_ps(mask)) << (i * 4);
+        }
+        bits[x / 32] = word;
+    }
+#endif
+    for(; x < width; x += 32)
+    {
+        uint32_t word = 0;
+        for(int i = 0; i < 32 && x + i < width; i++)
+            if(inclusive ? src[x + i] >= level : src[x + i] > level) word |= 1u << i;
+        bits[x / 32] = word;
+    }
+}
+
+CpuPreprocessor::CpuPreprocessor(int width, int height, std::shared_ptr<ThreadPool> pool)
+    : _width(width), _height(height), _packed_width((width + 31) / 32), _pool(pool)
+{
+    _gray.create(height, width, CV_8UC1);
+    _rows.create(height, width, CV_32FC1);
+    _row_sums.resize(height);
+}
+
+const char* CpuPreprocessor::simd()
+{
+#if defined(CPU_AVX2)
+    return "AVX2";
+#elif defined(CPU_SSSE3)
+    return "SSSE3";
+#else
+    return "scalar";
+#endif
+}
+
+void CpuPreprocessor::setBlur(int radius, const float* weights)
+{
+    _radius = std::max(0, radius);
+    _weights.assign(weights, weights + (_radius ? _radius + 1 : 0));
+}
+
+void CpuPreprocessor::parallelRows(const std::function<void(int, int)>& body)
+{
+    int chunks = _pool ? static_cast<int>(std::min<unsigned>(_pool->size(), _height)) : 1;
+    if(chunks <= 1)
+    {
+        body(0, _height);
+        return;
+    }
+    std::vector<std::future<void>> tasks;
+    for(int i = 0; i < chunks; i++)
+    {
+        int begin = _height * i / chunks, end = _height * (i + 1) / chunks;
+        tasks.push_back(_pool->submit([&body, begin, end]() {body(begin, end);}));
+    }
+    for(auto& task : tasks) task.get();
+}
+
+float CpuPreprocessor::process(const cv::Mat& frame, float threshold, int shades, std::vector<uint32_t>& bits)
+{
+    if(frame.cols != _width || frame.rows != _height || frame.type() != CV_8UC3)
+        throw std::runtime_error("CPU preprocessing needs 8-bit BGR frames of detection size!");
+    bits.resize(static_cast<size_t>(_packed_width) * _height);
+    // step 1: grayscale and horizontal blur, rows are independent
+    parallelRows([&](int begin, int end)
+    {
+        std::vector<float> pad(_radius ? _width + 2 * _radius : 0);
+        for(int y = begin; y < end; y++)
+        {
+            _row_sums[y] = grayRow(frame.ptr<uint8_t>(y), _gray.ptr<uint8_t>(y), _width);
+            if(_radius) blurRow(_gray.ptr<uint8_t>(y), _rows.ptr<float>(y), pad.data(), _width, _radius, _weights.data());
+        }
+    });
+    if(threshold < 0.0f)
+    {
+        // mean before blur, blurring keeps it apart from the borders
+        uint64_t sum = 0;
+        for(uint64_t rowSum : _row_sums) sum += rowSum;
+        threshold = static_cast<float>(sum) / (255.0f * _width * _height);
+    }
+    // quantized luma is above threshold from some luma level on (inclusive)
+    float level = threshold * 255.0f;
+    bool inclusive = false;
+    if(shades > 1)
+    {
+        float first = std::floor(threshold * (shades - 1)) + 1.0f;
+        level = 255.0f * (first - 0.5f) / (shades - 1);
+        inclusive = true;
+    }
+    // step 2: vertical blur and threshold, output rows start from the bottom like the shaders
+    parallelRows([&](int begin, int end)
+    {
+        std::vector<float> column(_radius ? _width : 0);
+        std::vector<const float*> rows(2 * _radius + 1);
+        for(int y = begin; y < end; y++)
+        {
+            uint32_t* out = &bits[static_cast<size_t>(_height - 1 - y) * _packed_width];
+            if(!_radius)
+            {
+                // integer luma: first level that counts as white
+                int first = inclusive ? static_cast<int>(std::ceil(level)) : static_cast<int>(std::floor(level)) + 1;
+                if(first > 255) std::fill(out, out + _packed_width, 0u);
+                else packBytes(_gray.ptr<uint8_t>(y), out, _width, std::max(0, first));
+                continue;
+            }
+            for(int k = -_radius; k <= _radius; k++)
+                rows[k + _radius] = _rows.ptr<float>(std::min(std::max(y + k, 0), _height - 1));
+            blurColumn(rows.data(), column.data(), _width, _radius, _weights.data());
+            packFloats(column.data(), out, _width, level, inclusive);
+        }
+    });
+    return threshold;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include "threadpool.hpp"
+
+// CPU counterpart of the grayscale, blur and threshold compute passes,
+// for machines without an OpenGL 4.5 context
+// takes 8-bit BGR frames and writes the packed binary image read by contour tracing
+// (rows bottom-up, bit x % 32 of word x / 32 set if white, same as the shaders)
+class CpuPreprocessor
+{
+public:
+    // rows are split across the pool, without one everything runs on the caller
+    CpuPreprocessor(int width, int height, std::shared_ptr<ThreadPool> pool = nullptr);
+
+    // separable gaussian, weights[i] for offsets +-i, radius 0 disables blur
+    void setBlur(int radius, const float* weights);
+    // threshold in [0, 1], negative uses mean luma of the frame
+    // shades > 1 quantizes luma before thresholding
+    // return threshold that was applied
+    float process(const cv::Mat& frame, float threshold, int shades, std::vector<uint32_t>& bits);
+
+    // instruction set chosen at compile time
+    static const char* simd();
+
+private:
+    int _width, _height, _packed_width;
+    std::shared_ptr<ThreadPool> _pool;
+    int _radius = 0;
+    std::vector<float> _weights;
+    // top-down like the frame, horizontal blur pass in luma units (0..255)
+    cv::Mat _gray, _rows;
+    std::vector<uint64_t> _row_sums;
+
+    // run body(begin, end) on row ranges, return once all are done
+    void parallelRows(const std::function<void(int, int)>& body);
+};
@@ -0,0 +1,284 @@
+#include "framesource.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <cctype>
+#include <future>
+
+size_t frameBytes(PixelFormat format, int width, int height)
+{
+    size_t pixels = static_cast<size_t>(width) * height;
+    switch(format)
+    {
+        case PixelFormat::YUYV: return pixels * 2;
+        case PixelFormat::NV12: return pixels * 3 / 2;
+        case PixelFormat::GRAY: return pixels;
+        default:                return pixels * 3;
+    }
+}
+
+const char* formatName(PixelFormat format)
+{
+    switch(format)
+    {
+        case PixelFormat::YUYV: return "YUYV";
+        case PixelFormat::NV12: return "NV12";
+        case PixelFormat::GRAY: return "GRAY";
+        case PixelFormat::JPEG: return "MJPG";
+        default:                return "BGR";
+    }
+}
+
+bool parseFormat(const std::string& name, PixelFormat& format)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if(lower == "bgr") format = PixelFormat::BGR;
+    else if(lower == "yuyv") format = PixelFormat::YUYV;
+    else if(lower == "nv12") format = PixelFormat::NV12;
+    else if(lower == "mjpg" || lower == "jpeg") format = PixelFormat::JPEG;
+    else return false;
+    return true;
+}
+
+static bool loadDeviceCache(PixelFormat format, int& cameraId, int& api)
+{
+    std::ifstream inFile(DEVICE_CACHE_FILE);
+    int cachedFormat;
+    if(!(inFile >> cameraId >> api >> cachedFormat)) return false;
+    return cachedFormat == static_cast<int>(format);
+}
+
+static void saveDeviceCache(PixelFormat format, int cameraId, int api)
+{
+    std::ofstream outFile(DEVICE_CACHE_FILE);
+    outFile << cameraId << " " << api << " " << static_cast<int>(format) << std::endl;
+}
+
+DeviceSource::DeviceSource(PixelFormat format, int cameraId)
+{
+    int api = cv::CAP_ANY;
+    bool autodetect = cameraId < 0;
+    int cachedId, cachedAPI;
+    if(autodetect && loadDeviceCache(format, cachedId, cachedAPI))
+    {
+        // last working device opens directly with its backend
+        _cam = std::make_shared<cv::VideoCapture>();
+        if(_cam->open(cachedId, cachedAPI))
+        {
+            cameraId = cachedId;
+            api = cachedAPI;
+        }
+        else _cam = nullptr;
+    }
+    if(!_cam)
+        _cam = autodetect ? probeDevices(cameraId, api) : openDevice(cameraId, api);
+    if(!_cam)
+        throw std::runtime_error("Failed to open camera!");
+    _id = cameraId;
+    _backend = _cam->getBackendName();
+    // set properties
+    _cam->set(cv::CAP_PROP_FPS, 30.0);
+    int fourcc;
+    switch(format)
+    {
+        case PixelFormat::YUYV: fourcc = cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V'); break;
+        case PixelFormat::NV12: fourcc = cv::VideoWriter::fourcc('N', 'V', '1', '2'); break;
+        default:                fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G'); break;
+    }
+    bool fourccSet = _cam->set(cv::CAP_PROP_FOURCC, fourcc);
+    _cam->set(cv::CAP_PROP_FRAME_HEIGHT, 480);
+    // keep raw frames packed (or compressed), decoding happens later
+    if(format != PixelFormat::BGR && !_cam->set(cv::CAP_PROP_CONVERT_RGB, 0.0))
+        throw std::runtime_error("Camera backend cannot deliver raw frames!");
+    // BGR frames are converted by OpenCV whatever the driver picked,
+    // raw frames in another format would all be rejected later
+    int active = static_cast<int>(_cam->get(cv::CAP_PROP_FOURCC));
+    if(format != PixelFormat::BGR && (!fourccSet || active != fourcc))
+    {
+        char name[5] = {0};
+        for(int i = 0; i < 4; i++) name[i] = static_cast<char>((active >> (8 * i)) & 0xFF);
+        throw std::runtime_error("Camera does not deliver " + std::string(formatName(format)) +
+            " frames (driver uses '" + std::string(name) + "')!");
+    }
+    _format = format;
+    _width = static_cast<int>(_cam->get(cv::CAP_PROP_FRAME_WIDTH));
+    _height = static_cast<int>(_cam->get(cv::CAP_PROP_FRAME_HEIGHT));
+    if(autodetect) saveDeviceCache(format, _id, api);
+}
+
+DeviceSource::~DeviceSource()
+{
+    _cam->release();
+}
+
+bool DeviceSource::read(cv::Mat& frame)
+{
+    return _cam->read(frame);
+}
+
+std::shared_ptr<cv::VideoCapture> DeviceSource::openDevice(int cameraId, int& api)
+{
+    // directshow for Windows, V4L2 for Linux, finally autodetect
+#ifdef _WIN32
+    const int apis[] = {cv::CAP_DSHOW, cv::CAP_ANY};
+#else
+    const int apis[] = {cv::CAP_V4L2, cv::CAP_ANY};
+#endif
+    auto cam = std::make_shared<cv::VideoCapture>();
+    for(int candidate : apis)
+    {
+        if(cam->open(cameraId, candidate))
+        {
+            api = candidate;
+            return cam;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<cv::VideoCapture> DeviceSource::probeDevices(int& cameraId, int& api)
+{
+    // missing or slow devices cost one timeout in total instead of one each
+    std::vector<int> apis(DEVICE_PROBE_MAX_ID + 1, cv::CAP_ANY);
+    std::vector<std::future<std::shared_ptr<cv::VideoCapture>>> probes;
+    for(int id = 0; id <= DEVICE_PROBE_MAX_ID; id++)
+        probes.push_back(std::async(std::launch::async, [id, &apis]()
+        {
+            return openDevice(id, apis[id]);
+        }));
+    // highest id wins (secondary camera), opened capture is kept so it is not reopened
+    std::shared_ptr<cv::VideoCapture> found;
+    for(int id = DEVICE_PROBE_MAX_ID; id >= 0; id--)
+    {
+        std::shared_ptr<cv::VideoCapture> cam = probes[id].get();
+        if(!cam) continue;
+        if(found)
+        {
+            cam->release();
+            continue;
+        }
+        found = cam;
+        cameraId = id;
+        api = apis[id];
+    }
+    return found;
+}
+
+void ReplaySource::pace()
+{
+    if(_mode != ReplayMode::Realtime) return;
+    auto now = std::chrono::steady_clock::now();
+    if(_next > now) std::this_thread::sleep_until(_next);
+    else _next = now;
+    _next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / _fps));
+}
+
+VideoFileSource::VideoFileSource(const std::string& path, ReplayMode mode)
+    : ReplaySource(mode, 30.0), _path(path)
+{
+    if(!_video.open(path))
+        throw std::runtime_error("Failed to open video file: " + path);
+    double fps = _video.get(cv::CAP_PROP_FPS);
+    if(fps > 0.0) _fps = fps;
+    _width = static_cast<int>(_video.get(cv::CAP_PROP_FRAME_WIDTH));
+    _height = static_cast<int>(_video.get(cv::CAP_PROP_FRAME_HEIGHT));
+}
+
+VideoFileSource::~VideoFileSource()
+{
+    _video.release();
+}
+
+bool VideoFileSource::read(cv::Mat& frame)
+{
+    if(_finished) return false;
+    pace();
+    if(_video.read(frame)) return true;
+    if(_mode == ReplayMode::Fast)
+    {
+        _finished = true;
+        return false;
+    }
+    // loop realtime replay from the beginning
+    _video.set(cv::CAP_PROP_POS_FRAMES, 0.0);
+    return _video.read(frame);
+}
+
+bool isImageFile(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    if(dot == std::string::npos) return false;
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+}
+
+ImageSequenceSource::ImageSequenceSource(const std::string& path, ReplayMode mode, double fps)
+    : ReplaySource(mode, fps), _path(path)
+{
+    std::vector<cv::String> files;
+    cv::glob(path, files, false);
+    for(auto& file : files)
+        if(isImageFile(file)) _files.push_back(file);
+    if(_files.empty())
+        throw std::runtime_error("No images found in: " + path);
+    // sorted so replay order is deterministic
+    std::sort(_files.begin(), _files.end());
+    cv::Mat first = cv::imread(_files[0]);
+    if(first.empty())
+        throw std::runtime_error("Failed to read image: " + _files[0]);
+    _width = first.cols;
+    _height = first.rows;
+}
+
+bool ImageSequenceSource::read(cv::Mat& frame)
+{
+    if(_finished) return false;
+    pace();
+    frame = cv::imread(_files[_current]);
+    _current++;
+    if(_current >= _files.size())
+    {
+        if(_mode == ReplayMode::Fast) _finished = true;
+        _current = 0;
+    }
+    if(frame.empty()) return false;
+    // all frames have to match the texture size
+    if(frame.cols != _width || frame.rows != _height)
+        cv::resize(frame, frame, cv::Size(_width, _height));
+    return true;
+}
+
+RawFileSource::RawFileSource(const std::string& path, int width, int height,
+    PixelFormat format, ReplayMode mode, double fps)
+    : ReplaySource(mode, fps), _path(path), _file(path.c_str(), std::ios::binary)
+{
+    if(!_file.is_open())
+        throw std::runtime_error("Failed to open raw file: " + path);
+    if(format == PixelFormat::BGR || width <= 0 || height <= 0 || (width % 2) || (height % 2))
+        throw std::runtime_error("Raw frames need YUYV or NV12 format and an even size!");
+    _width = width;
+    _height = height;
+    _format = format;
+}
+
+bool RawFileSource::read(cv::Mat& frame)
+{
+    if(_finished) return false;
+    pace();
+    if(_format == PixelFormat::YUYV) frame.create(_height, _width, CV_8UC2);
+    else frame.create(_height * 3 / 2, _width, CV_8UC1);
+    std::streamsize bytes = static_cast<std::streamsize>(frameBytes(_format, _width, _height));
+    if(_file.read(reinterpret_cast<char*>(frame.data), bytes)) return true;
+    if(_mode == ReplayMode::Fast)
+    {
+        _finished = true;
+        return false;
+    }
+    // loop realtime replay from the beginning
+    _file.clear();
+    _file.seekg(0);
+    return static_cast<bool>(_file.read(reinterpret_cast<char*>(frame.data), bytes));
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <memory>
+
+// last working (device id, backend, format), skips probing on next start
+#define DEVICE_CACHE_FILE "camera.cache"
+#ifdef linux
+#define DEVICE_PROBE_MAX_ID 5
+#else
+#define DEVICE_PROBE_MAX_ID 0
+#endif
+
+// how recorded frames are delivered
+enum class ReplayMode
+{
+    // paced at recorded frame rate, loops forever, frames may be dropped like a webcam
+    Realtime,
+    // as fast as consumer can take them, every frame delivered exactly once
+    Fast,
+};
+
+// memory layout of frames produced by a source
+enum class PixelFormat
+{
+    // packed 8-bit BGR, CV_8UC3
+    BGR,
+    // packed 4:2:2 Y0 U Y1 V, CV_8UC2 (height x width)
+    YUYV,
+    // Y plane followed by interleaved UV plane, CV_8UC1 (height*3/2 x width)
+    NV12,
+    // 8-bit luma only, CV_8UC1
+    // (internal upload format of decoded MJPG luma, no source delivers it)
+    GRAY,
+    // undecoded MJPG frame, CV_8UC1 (1 x compressed size)
+    JPEG,
+};
+
+// where a texture handed to marker detection keeps its luma
+enum class LumaLayout
+{
+    // rgb color, luma computed from it
+    RGB = 0,
+    // rgb color with luma in alpha
+    Alpha = 1,
+    // luma only, in red channel
+    Red = 2,
+};
+
+// size in bytes of one frame in given format
+// (upper bound of decoded BGR size for JPEG)
+size_t frameBytes(PixelFormat format, int width, int height);
+const char* formatName(PixelFormat format);
+bool parseFormat(const std::string& name, PixelFormat& format);
+
+// whether path has a known image extension
+bool isImageFile(const std::string& path);
+
+// abstract source of camera frames
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+
+    // read next frame (blocking), return false if no frame available
+    virtual bool read(cv::Mat& frame) = 0;
+    // whether source ran out of frames
+    virtual bool finished() const {return false;}
+    // whether every frame must reach the consumer (no dropping)
+    virtual bool deterministic() const {return false;}
+    virtual std::string name() const = 0;
+    // when the last frame was captured, sources without their own clock say now
+    virtual std::chrono::steady_clock::time_point captured() const {return std::chrono::steady_clock::now();}
+
+    int width() const {return _width;}
+    int height() const {return _height;}
+    PixelFormat format() const {return _format;}
+
+protected:
+    int _width = 0, _height = 0;
+    PixelFormat _format = PixelFormat::BGR;
+};
+
+// live webcam
+// BGR decodes MJPG on CPU, YUYV and NV12 hand raw frames to GPU conversion
+// JPEG hands undecoded MJPG frames to camera for luma-only decoding
+class DeviceSource : public FrameSource
+{
+public:
+    // cameraId < 0 opens the cached device of the last run,
+    // or probes all device ids concurrently if it is gone
+    DeviceSource(PixelFormat format = PixelFormat::BGR, int cameraId = -1);
+    ~DeviceSource();
+
+    bool read(cv::Mat& frame);
+    std::string name() const {return "Device " + std::to_string(_id) + " (" + _backend + ")";}
+
+private:
+    std::shared_ptr<cv::VideoCapture> _cam;
+    std::string _backend;
+    int _id;
+
+    // open device trying backends in preference order, api is set to the one that worked
+    static std::shared_ptr<cv::VideoCapture> openDevice(int cameraId, int& api);
+    // open highest working device id, every id is probed on its own thread
+    static std::shared_ptr<cv::VideoCapture> probeDevices(int& cameraId, int& api);
+};
+
+// base for sources replaying prerecorded frames
+class ReplaySource : public FrameSource
+{
+public:
+    ReplaySource(ReplayMode mode, double fps) : _mode(mode), _fps(fps) {}
+
+    bool finished() const {return _finished;}
+    bool deterministic() const {return _mode == ReplayMode::Fast;}
+
+protected:
+    ReplayMode _mode;
+    double _fps;
+    bool _finished = false;
+    std::chrono::steady_clock::time_point _next;
+
+    // sleep until next frame is due in realtime mode
+    void pace();
+};
+
+// video file decoded through OpenCV
+class VideoFileSource : public ReplaySource
+{
+public:
+    VideoFileSource(const std::string& path, ReplayMode mode);
+    ~VideoFileSource();
+
+    bool read(cv::Mat& frame);
+    std::string name() const {return "Video (" + _path + ")";}
+
+private:
+    std::string _path;
+    cv::VideoCapture _video;
+};
+
+// directory (or glob pattern) of images, e.g. OpenCV/samples/*.jpg
+class ImageSequenceSource : public ReplaySource
+{
+public:
+    ImageSequenceSource(const std::string& path, ReplayMode mode, double fps = 30.0);
+
+    bool read(cv::Mat& frame);
+    std::string name() const {return "Images (" + _path + ")";}
+
+private:
+    std::string _path;
+    std::vector<cv::String> _files;
+    size_t _current = 0;
+};
+
+// file of concatenated raw YUYV or NV12 frames without header
+// e.g. ffmpeg -i in.mp4 -f rawvideo -pix_fmt yuyv422 frames.yuyv
+class RawFileSource : public ReplaySource
+{
+public:
+    RawFileSource(const std::string& path, int width, int height,
+        PixelFormat format, ReplayMode mode, double fps = 30.0);
+
+    bool read(cv::Mat& frame);
+    std::string name() const {return "Raw " + std::string(formatName(_format)) + " (" + _path + ")";}
+
+private:
+    std::string _path;
+    std::ifstream _file;
+};
\ No newline at end of file
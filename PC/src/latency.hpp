@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#define LATENCY_HISTORY 240
+
+// points in a frame's life, in pipeline order
+enum class LatencyStage
+{
+    // frame returned by source on capture thread
+    Capture = 0,
+    // frame picked up and uploaded on GL thread
+    Upload,
+    // grayscale, threshold and readback done
+    Preprocess,
+    // contour tracking done
+    Detect,
+    // pose estimated
+    Pose,
+    // model rendered with the pose
+    Render,
+    // buffers swapped
+    Present,
+    Count,
+};
+
+const char* const LatencyStageNames[] = {
+    "Capture", "Upload", "Preprocess", "Detect", "Pose", "Render", "Present"
+};
+
+// timestamps of one frame from capture to screen
+struct FrameTiming
+{
+    typedef std::chrono::steady_clock Clock;
+
+    uint64_t id = 0;
+    Clock::time_point stamps[static_cast<int>(LatencyStage::Count)];
+
+    void stamp(LatencyStage stage) {stamp(stage, Clock::now());}
+    void stamp(LatencyStage stage, Clock::time_point time) {stamps[static_cast<int>(stage)] = time;}
+    // milliseconds from capture until given stage
+    float since(LatencyStage stage) const {return elapsed(LatencyStage::Capture, stage);}
+    // milliseconds between two stages
+    float elapsed(LatencyStage from, LatencyStage to) const
+    {
+        std::chrono::duration<float, std::milli> delta =
+            stamps[static_cast<int>(to)] - stamps[static_cast<int>(from)];
+        return delta.count();
+    }
+};
+
+// rolling per-stage latency of the last frames of one pipeline
+class LatencyTracker
+{
+public:
+    LatencyTracker() {reset();}
+
+    // forget recorded latencies (dropped frame count is kept)
+    void reset()
+    {
+        std::fill(&_deltas[0][0], &_deltas[0][0] + sizeof(_deltas) / sizeof(float), 0.0f);
+        std::fill(_total, _total + LATENCY_HISTORY, 0.0f);
+        _index = 0;
+        _frames = 0;
+        _sum = 0.0;
+    }
+
+    // record a frame whose stamps are valid up to last stage
+    // all samples end at the same stage, history restarts when it changes
+    // (pipeline shown on screen ends at Present, hidden ones at Pose)
+    void add(const FrameTiming& timing, LatencyStage last)
+    {
+        if(last != _last) reset();
+        // gaps in frame ids are frames dropped before processing
+        if(_frames && timing.id > _last_id + 1) _dropped += timing.id - _last_id - 1;
+        _last_id = timing.id;
+        int lastIdx = static_cast<int>(last);
+        for(int i = 1; i < static_cast<int>(LatencyStage::Count); i++)
+            _deltas[i][_index] = i <= lastIdx ? timing.elapsed(
+                static_cast<LatencyStage>(i - 1), static_cast<LatencyStage>(i)) : 0.0f;
+        _total[_index] = timing.since(last);
+        _sum += _total[_index];
+        _last = last;
+        _index = (_index + 1) % LATENCY_HISTORY;
+        _frames++;
+    }
+
+    // mean end-to-end latency over all recorded frames
+    float mean() const {return _frames ? static_cast<float>(_sum / _frames) : 0.0f;}
+    uint64_t frames() const {return _frames;}
+    // stage the recorded latencies end at
+    LatencyStage last() const {return _last;}
+
+    void UI();
+
+private:
+    // per-stage delta to the previous stage, ring of last frames
+    float _deltas[static_cast<int>(LatencyStage::Count)][LATENCY_HISTORY];
+    float _total[LATENCY_HISTORY];
+    int _index = 0;
+    uint64_t _frames = 0;
+    uint64_t _last_id = 0;
+    uint64_t _dropped = 0;
+    double _sum = 0.0;
+    LatencyStage _last = LatencyStage::Present;
+};
\ No newline at end of file
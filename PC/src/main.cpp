@@ -3,6 +3,10 @@
 #include "model.hpp"
 #include "shader.hpp"
 #include "marker.hpp"
+#include "session.hpp"
+#include "shmsource.hpp"
+#include "threadpool.hpp"
+#include "latency.hpp"
 
 #include <GL/glew.h>
 #include <imgui.h>
@@ -10,32 +14,194 @@
 #include <stdexcept>
 #include <memory>
 #include <functional>
+#include <string>
+#include <chrono>
+#include <sstream>
+#include <cstdlib>
+#include <vector>
+#include <future>
+#include <algorithm>
 
-int main()
+// one capture + detection pipeline per camera
+struct Pipeline
 {
-    std::shared_ptr<Context> con;
-    std::shared_ptr<Camera> cam;
+    std::shared_ptr<Camera> camera;
     std::shared_ptr<Marker> marker;
-    std::shared_ptr<Shader> render;
+    // CPU detection and pose estimation running on worker pool
+    std::future<void> detection;
+    bool updated = false;
+    // frame currently in flight and latency of finished ones
+    FrameTiming timing;
+    LatencyTracker latency;
+};
+
+struct Options
+{
+    bool fast = false;
+    // capture pixels per detection pixel along each axis
+    int detectScale = 1;
+    std::string recordPath;
+    bool recordCompress = false;
+    std::string outputPath;
+    bool cpu = false;
+};
+
+// replay source picked by path extension
+std::shared_ptr<FrameSource> createReplaySource(const std::string& path,
+    PixelFormat format, int width, int height, ReplayMode mode)
+{
+    size_t slash = path.find_last_of("/\\");
+    size_t dot = path.find_last_of('.');
+    bool hasExtension = dot != std::string::npos &&
+        (slash == std::string::npos || slash < dot);
+    if(hasExtension && path.substr(dot + 1) == "mrk")
+        return std::make_shared<SessionSource>(path, mode);
+    if(hasExtension && parseFormat(path.substr(dot + 1), format) &&
+        (format == PixelFormat::YUYV || format == PixelFormat::NV12))
+        return std::make_shared<RawFileSource>(path, width, height, format, mode);
+    if(hasExtension && path.find('*') == std::string::npos && !isImageFile(path))
+        return std::make_shared<VideoFileSource>(path, mode);
+    return std::make_shared<ImageSequenceSource>(path, mode);
+}
+
+// pick frame sources from command line, every path or device is one camera
+// marker                    -> webcam
+// marker --device 0 --device 2 -> several webcams
+// marker <video file>       -> video replay
+// marker <directory|glob>   -> image sequence replay
+// marker <file.yuyv|file.nv12> --size WxH -> raw frame replay
+// marker <session.mrk>      -> recorded session replay (memory mapped)
+// marker shm:/<name>        -> frames from external process through shared memory ring
+// append --fast to replay every frame once as fast as possible (benchmark)
+// append --format yuyv|nv12 to capture raw webcam frames
+// append --format mjpg to decode only luma for detection
+// append --detect-scale 1|2|4 (or --luma-scale) to detect on a reduced image,
+// corners are refined on the full resolution frame
+// append --record <session.mrk> [--compress] to record captured frames
+// append --record-output <video file|directory> to record what is shown on screen
+// append --cpu to preprocess BGR frames on CPU instead of compute shaders
+std::vector<std::shared_ptr<FrameSource>> createSources(int argc, char* argv[], Options& options)
+{
+    std::vector<std::string> paths;
+    std::vector<int> devices;
+    PixelFormat format = PixelFormat::BGR;
+    int width = 0, height = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--fast") options.fast = true;
+        else if(arg == "--format" && i + 1 < argc)
+        {
+            if(!parseFormat(argv[++i], format))
+                throw std::runtime_error("Unknown pixel format: " + std::string(argv[i]));
+        }
+        else if(arg == "--device" && i + 1 < argc)
+            devices.push_back(std::atoi(argv[++i]));
+        else if(arg == "--record" && i + 1 < argc) options.recordPath = argv[++i];
+        else if(arg == "--compress") options.recordCompress = true;
+        else if(arg == "--cpu") options.cpu = true;
+        else if(arg == "--record-output" && i + 1 < argc) options.outputPath = argv[++i];
+        else if((arg == "--detect-scale" || arg == "--luma-scale") && i + 1 < argc)
+            options.detectScale = std::atoi(argv[++i]);
+        else if(arg == "--size" && i + 1 < argc)
+        {
+            char x;
+            std::stringstream sstr(argv[++i]);
+            if(!(sstr >> width >> x >> height))
+                throw std::runtime_error("Invalid frame size: " + std::string(argv[i]));
+        }
+        else paths.push_back(arg);
+    }
+    std::vector<std::shared_ptr<FrameSource>> sources;
+    if(paths.empty() && devices.empty())
+        devices.push_back(-1);
+    for(int id : devices)
+        sources.push_back(std::make_shared<DeviceSource>(format, id));
+    ReplayMode mode = options.fast ? ReplayMode::Fast : ReplayMode::Realtime;
+    for(auto& path : paths)
+    {
+        if(path.compare(0, 4, "shm:") == 0)
+            sources.push_back(std::make_shared<ShmSource>(path.substr(4)));
+        else
+            sources.push_back(createReplaySource(path, format, width, height, mode));
+    }
+    return sources;
+}
+
+// session.mrk -> session0.mrk, session1.mrk, ... when recording several cameras
+std::string recordPath(const std::string& path, size_t index, size_t count)
+{
+    if(count <= 1) return path;
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && slash > dot))
+        dot = path.size();
+    return path.substr(0, dot) + std::to_string(index) + path.substr(dot);
+}
+
+int main(int argc, char* argv[])
+{
+    std::shared_ptr<Context> con;
+    std::vector<Pipeline> pipelines;
+    std::shared_ptr<ThreadPool> pool;
+    // rows of CPU preprocessing, separate from detection tasks
+    std::shared_ptr<ThreadPool> rowPool;
+    // camera frame and debug view of marker images
+    std::shared_ptr<Shader> render, renderDebug;
     std::shared_ptr<Model> model;
+    Options options;
+    // pipeline shown on screen and in UI
+    int display = 0;
 
     // initialze all
     try
     {
+        // opening cameras may take seconds, overlap it with GL and shader setup
+        // (options are filled by the probe, only read them after get())
+        std::future<std::vector<std::shared_ptr<FrameSource>>> probe = std::async(
+            std::launch::async, createSources, argc, argv, std::ref(options));
         con = std::make_shared<Context>("Marker");
-        cam = std::make_shared<Camera>();
-        marker = std::make_shared<Marker>(
-            cam->width(),
-            cam->height()
-        );
+        const ShaderCache::Sources renderSources = {
+            {"shaders/render.vert.glsl", GL_VERTEX_SHADER},
+            {"shaders/render.frag.glsl", GL_FRAGMENT_SHADER},
+        };
+        render = ShaderCache::get(renderSources, {{"DEBUG", "0"}});
+        renderDebug = ShaderCache::get(renderSources, {{"DEBUG", "1"}});
+        std::vector<std::shared_ptr<Shader>> shaders = Marker::loadShaders();
+        auto sources = probe.get();
+        for(size_t i = 0; i < sources.size(); i++)
+        {
+            Pipeline pipeline;
+            pipeline.camera = std::make_shared<Camera>(sources[i], options.detectScale);
+            if(!options.recordPath.empty())
+                pipeline.camera->startRecording(
+                    recordPath(options.recordPath, i, sources.size()), options.recordCompress);
+            pipeline.marker = std::make_shared<Marker>(
+                pipeline.camera->detectWidth(),
+                pipeline.camera->detectHeight()
+            );
+            pipeline.marker->setImageScale(pipeline.camera->detectScale());
+            if(options.cpu)
+            {
+                if(pipeline.camera->format() != PixelFormat::BGR)
+                    throw std::runtime_error("CPU preprocessing needs BGR frames!");
+                if(options.detectScale != 1)
+                    throw std::runtime_error("CPU preprocessing runs at full resolution only!");
+                if(!rowPool) rowPool = std::make_shared<ThreadPool>(std::thread::hardware_concurrency());
+                pipeline.marker->enableCPU(rowPool);
+            }
+            pipelines.push_back(std::move(pipeline));
+        }
+        if(options.fast) con->limitFPS(false);
+        if(!options.outputPath.empty()) con->startRecording(options.outputPath);
+        // one task per pipeline and frame, more workers would idle
+        pool = std::make_shared<ThreadPool>(std::min(
+            static_cast<unsigned>(pipelines.size()),
+            std::max(1u, std::thread::hardware_concurrency())));
         model = std::make_shared<ModelTyra>(
-            cam->width(),
-            cam->height()
+            pipelines[0].camera->width(),
+            pipelines[0].camera->height()
         );
-        render = std::make_shared<Shader>();
-        render->add("shaders/render.vert.glsl", GL_VERTEX_SHADER);
-        render->add("shaders/render.frag.glsl", GL_FRAGMENT_SHADER);
-        render->compile();
     }
     catch(const std::exception& e)
     {
@@ -46,9 +212,14 @@ int main()
     // create UI function
     auto renderUI = [&]()
     {
+        std::shared_ptr<Camera> cam = pipelines[display].camera;
+        std::shared_ptr<Marker> marker = pipelines[display].marker;
         ImGui::SetNextWindowSize({300.0f, 200.0f}, ImGuiCond_FirstUseEver);
         ImGui::SetNextWindowPos({10.0f, 10.0f}, ImGuiCond_FirstUseEver);
         ImGui::Begin("UI");
+        // camera, marker and pose tabs show the displayed pipeline
+        if(pipelines.size() > 1)
+            ImGui::SliderInt("Display Camera", &display, 0, static_cast<int>(pipelines.size()) - 1);
         if(ImGui::BeginTabBar("Configs"))
         {
             if(ImGui::BeginTabItem("Context"))
@@ -76,50 +247,124 @@ int main()
                 model->UI();
                 ImGui::EndTabItem();
             }
+            if(ImGui::BeginTabItem("Latency"))
+            {
+                pipelines[display].latency.UI();
+                ImGui::EndTabItem();
+            }
             ImGui::EndTabBar();
         }
         ImGui::End();
     };
+    // replays in fast mode end once every camera ran out of frames
+    auto finished = [&]()
+    {
+        for(auto& pipeline : pipelines)
+            if(!pipeline.camera->finished()) return false;
+        return true;
+    };
 
     // main loop
-    while(con->loop())
+    unsigned processed = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(con->loop() && !finished())
     {
         con->beginFrame();
-        // fetch latest image
-        cam->update();
-        // process image
-        marker->process(
-            cam->lastTex(),
-            cam->groupX(),
-            cam->groupY()
-        );
-        // estimate pose
-        marker->estimatePoseSVD(
-            cam->cameraK(),
-            cam->cameraInvK(),
-            cam->cameraDistK(),
-            cam->cameraDistP()
-        );
+        // fetch latest image of every camera, only process when a new frame arrived
+        // GPU preprocessing runs here on GL thread, contour tracking and pose
+        // estimation of one camera overlap with preprocessing of the next one
+        for(auto& pipeline : pipelines)
+        {
+            std::shared_ptr<Camera> cam = pipeline.camera;
+            std::shared_ptr<Marker> marker = pipeline.marker;
+            pipeline.updated = cam->update();
+            if(!pipeline.updated) continue;
+            FrameTiming* timing = &pipeline.timing;
+            *timing = cam->timing();
+            // process image
+            if(options.cpu)
+                marker->preprocess(cam->frame());
+            else
+                marker->preprocess(
+                    cam->detectTex(),
+                    cam->detectGroupX(),
+                    cam->detectGroupY(),
+                    cam->detectLuma(),
+                    cam->detectSample()
+                );
+            timing->stamp(LatencyStage::Preprocess);
+            pipeline.detection = pool->submit([cam, marker, timing]()
+            {
+                marker->detect();
+                marker->refineCorners(cam->refineFrame(), cam->refineFormat());
+                timing->stamp(LatencyStage::Detect);
+                // estimate pose
+                marker->estimatePoseSVD(
+                    cam->cameraK(),
+                    cam->cameraInvK(),
+                    cam->cameraDistK(),
+                    cam->cameraDistP()
+                );
+                timing->stamp(LatencyStage::Pose);
+            });
+        }
+        // wait for detection before UI may change any marker settings
+        for(auto& pipeline : pipelines)
+        {
+            if(!pipeline.updated) continue;
+            pipeline.detection.get();
+            pipeline.marker->finish();
+            processed++;
+        }
+        // poses of hidden cameras are done here, shown one goes on to screen
+        Pipeline& shown = pipelines[display];
+        for(auto& pipeline : pipelines)
+            if(pipeline.updated && &pipeline != &shown)
+                pipeline.latency.add(pipeline.timing, LatencyStage::Pose);
+        std::shared_ptr<Camera> cam = shown.camera;
+        std::shared_ptr<Marker> marker = shown.marker;
         // render camera frome to screen
-        glUseProgram(render->program());
+        std::shared_ptr<Shader> screen = marker->debug() ? renderDebug : render;
+        glUseProgram(screen->program());
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, marker->debug() ?
             marker->lastTex() : cam->lastTex());
-        render->uniformInt("image", 0);
-        render->uniformFloat("ratio_img", cam->ratio());
-        render->uniformFloat("ratio_win", con->ratio());
-        render->uniformBool("debug", marker->debug());
+        screen->uniformInt("image", 0);
+        screen->uniformFloat("ratio_img", cam->ratio());
+        screen->uniformFloat("ratio_win", con->ratio());
         cam->draw();
         glUseProgram(0);
         marker->drawCorners(con->ratio(), cam->ratio());
-        // use estimated pose to render a model
+        // use estimated pose to render a model, cameras may differ in size
+        model->setCameraSize(cam->width(), cam->height());
         model->render(
             cam->cameraK(), marker->poseM(),
             cam->cameraProj(),
             cam->ratio(), con->ratio()
         );
+        shown.timing.stamp(LatencyStage::Render);
         con->endFrame(renderUI);
+        if(shown.updated)
+        {
+            shown.timing.stamp(LatencyStage::Present, con->lastSwap());
+            shown.latency.add(shown.timing, LatencyStage::Present);
+        }
+    }
+
+    if(options.fast)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if(options.cpu)
+            std::cout << "CPU preprocessing: " << CpuPreprocessor::simd() << ", "
+                << rowPool->size() << " threads" << std::endl;
+        std::cout << "Processed " << processed << " frames from " << pipelines.size()
+            << " cameras in " << elapsed.count() << "s ("
+            << processed / elapsed.count() << " FPS)" << std::endl;
+        for(size_t i = 0; i < pipelines.size(); i++)
+            std::cout << "Camera " << i << " mean latency to "
+                << LatencyStageNames[static_cast<int>(pipelines[i].latency.last())] << ": "
+                << pipelines[i].latency.mean() << "ms" << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -2,121 +2,520 @@
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-Marker::Marker(int width, int height) : _width(width), _height(height),
+Marker::Marker(int width, int height, bool gpu) : _width(width), _height(height), _gpu(gpu),
     _marker_borderp1p2(0.0f), _marker_borderp3p4(0.0f)
 {
     // config
     _auto_threshold_level = 1 + static_cast<int>(
         std::floor(std::log2(static_cast<double>(std::max(width, height))))
     );
-    _image_data.resize(width * height);
+    _packed_width = (width + 31) / 32;
+    _image_bits.resize(_packed_width * height);
+    _visited.resize(_packed_width * height);
     _image_scan_step = static_cast<int>(std::floor(height / 20.0f)); // assume that the marker is near camera, covering at least 1/20 screen height
+    _roi = _roi_next = glm::ivec4(0, 0, width, height);
+    _lastTex = 0;
+    if(!gpu) return;
     // initialize texture buffer
-    glGenTextures(2, _tex);
-    for(int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, _tex[i]);
-        glTexStorage2D(GL_TEXTURE_2D, _auto_threshold_level, GL_R32F, width, height);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_2D, 0);
-    }
+    glGenTextures(1, &_texGray);
+    glBindTexture(GL_TEXTURE_2D, _texGray);
+    glTexStorage2D(GL_TEXTURE_2D, _auto_threshold_level, GL_R8, width, height);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // binary image only holds the sign, no mipmaps needed
+    glGenTextures(1, &_texBinary);
+    glBindTexture(GL_TEXTURE_2D, _texBinary);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8_SNORM, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glGenTextures(1, &_texPacked);
+    glBindTexture(GL_TEXTURE_2D, _texPacked);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, _packed_width, height);
+    glGenTextures(1, &_texBlur);
+    glBindTexture(GL_TEXTURE_2D, _texBlur);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    _lastTex = _texGray;
     // prepare buffers
     glGenBuffers(1, &_drawVBO);
     glBindBuffer(GL_ARRAY_BUFFER, _drawVBO);
     glBufferStorage(GL_ARRAY_BUFFER, 8 * sizeof(float), nullptr, GL_MAP_WRITE_BIT);
     // glBufferData(GL_ARRAY_BUFFER, 8 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &_sumBuffer);
+    glNamedBufferStorage(_sumBuffer, sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glGenBuffers(1, &_histBuffer);
+    glNamedBufferStorage(_histBuffer, 257 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    const GLbitfield readFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &_sumReadback);
+    glNamedBufferStorage(_sumReadback, sizeof(uint32_t), nullptr, readFlags);
+    _sum_mapped = static_cast<const uint32_t*>(
+        glMapNamedBufferRange(_sumReadback, 0, sizeof(uint32_t), readFlags));
+    size_t packedBytes = _image_bits.size() * sizeof(uint32_t);
+    glGenBuffers(1, &_readbackPBO);
+    glNamedBufferStorage(_readbackPBO, packedBytes * 2, nullptr, readFlags);
+    _readback_ptr = static_cast<const uint8_t*>(
+        glMapNamedBufferRange(_readbackPBO, 0, packedBytes * 2, readFlags));
     glGenVertexArrays(1, &_drawVAO);
     glBindVertexArray(_drawVAO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
     glBindVertexArray(0);
-    // prepare threshold shader
-    _shader1 = std::make_shared<Shader>();
-    _shader1->add("shaders/grayscale.comp.glsl", GL_COMPUTE_SHADER);
-    _shader1->compile();
-    _shader2 = std::make_shared<Shader>();
-    _shader2->add("shaders/threshold.comp.glsl", GL_COMPUTE_SHADER);
-    _shader2->compile();
-    _shaderDraw = std::make_shared<Shader>();
-    _shaderDraw->add("shaders/corners.vert.glsl", GL_VERTEX_SHADER);
-    _shaderDraw->add("shaders/corners.frag.glsl", GL_FRAGMENT_SHADER);
-    _shaderDraw->compile();
+    // prepare threshold shader, shared by all markers
+    std::vector<std::shared_ptr<Shader>> shaders = loadShaders();
+    _shader1 = shaders[0];
+    _shader2 = shaders[1];
+    _shaderDraw = shaders[2];
+    _shaderFused = shaders[3];
+    _shaderBlur = shaders[4];
+    _shaderMeans = shaders[5];
+    _shaderMean = shaders[6];
+    _shaderHist = shaders[7];
+    _shaderOtsu = shaders[8];
+}
+
+std::vector<std::shared_ptr<Shader>> Marker::loadShaders()
+{
+    // variants of default settings on RGB frames, others are compiled on first use
+    ShaderDefines gray = {
+        {"LUMA_LAYOUT", std::to_string(static_cast<int>(LumaLayout::RGB))},
+        {"SAMPLE_SCALE", "1"},
+        {"QUANTIZE", "0"},
+        {"BLUR_FILTER", "0"},
+    };
+    ShaderDefines fused = gray;
+    fused["BLUR_MODE"] = std::to_string(static_cast<int>(BlurMode::Gaussian));
+    fused["BINARY_IMAGE"] = "0";
+    return {
+        ShaderCache::compute("shaders/grayscale.comp.glsl", gray),
+        ShaderCache::compute("shaders/threshold.comp.glsl", {{"BINARY_IMAGE", "0"}}),
+        ShaderCache::get({
+            {"shaders/corners.vert.glsl", GL_VERTEX_SHADER},
+            {"shaders/corners.frag.glsl", GL_FRAGMENT_SHADER},
+        }),
+        ShaderCache::compute("shaders/preprocess.comp.glsl", fused),
+        ShaderCache::compute("shaders/blur.comp.glsl"),
+        ShaderCache::compute("shaders/tilemean.comp.glsl"),
+        ShaderCache::compute("shaders/mean.comp.glsl"),
+        ShaderCache::compute("shaders/histogram.comp.glsl"),
+        ShaderCache::compute("shaders/otsu.comp.glsl"),
+    };
 }
 
 Marker::~Marker()
 {
-    glDeleteTextures(2, _tex);
+    if(!_gpu) return;
+    glDeleteTextures(1, &_texGray);
+    glDeleteTextures(1, &_texBinary);
+    glDeleteTextures(1, &_texBlur);
+    glDeleteTextures(1, &_texPacked);
+    if(_texMeans) glDeleteTextures(1, &_texMeans);
     glDeleteBuffers(1, &_drawVBO);
+    for(GLsync fence : _readback_fence)
+        if(fence) glDeleteSync(fence);
+    glUnmapNamedBuffer(_readbackPBO);
+    glDeleteBuffers(1, &_readbackPBO);
+    if(_sum_fence) glDeleteSync(_sum_fence);
+    glUnmapNamedBuffer(_sumReadback);
+    glDeleteBuffers(1, &_sumReadback);
+    glDeleteBuffers(1, &_sumBuffer);
+    glDeleteBuffers(1, &_histBuffer);
     glDeleteVertexArrays(1, &_drawVAO);
 }
 
-void Marker::process(GLuint sourceImg, int groupX, int groupY)
+void Marker::process(GLuint sourceImg, int groupX, int groupY, LumaLayout luma, int sampleScale)
 {
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    preprocess(sourceImg, groupX, groupY, luma, sampleScale);
+    detect();
+    finish();
+}
+
+void Marker::preprocess(GLuint sourceImg, int groupX, int groupY, LumaLayout luma, int sampleScale)
+{
+    _detect_pending = false;
+    _cpu_frame = false;
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    bool gaussian = _blur && _blur_mode == static_cast<int>(BlurMode::Gaussian);
+    if(gaussian) updateGaussWeights();
+    // stable tracking: only process the box around last corners, lost marker falls back to full image
+    // (async readback traces the previous frame, adaptive tile means cover the whole image)
+    _roi = glm::ivec4(0, 0, _width, _height);
+    if(_roi_tracking && _tracked_frames >= ROI_TRACKED_FRAMES && !_async_readback &&
+        _threshold_mode != static_cast<int>(ThresholdMode::Adaptive))
+    {
+        _roi = _roi_next;
+        groupX = (_roi.z - _roi.x + 31) / 32;
+        groupY = (_roi.w - _roi.y + 31) / 32;
+    }
+    glm::ivec2 roiOrigin(_roi.x, _roi.y);
+    // switches known before dispatch are compiled into the programs
+    ShaderDefines defines = {
+        {"LUMA_LAYOUT", std::to_string(static_cast<int>(luma))},
+        {"SAMPLE_SCALE", std::to_string(sampleScale)},
+        {"QUANTIZE", _gray_shades > 1 ? "1" : "0"},
+    };
+    // grayscale image is only needed for auto threshold and grayscale debug view
+    if(_fused && _threshold_mode == static_cast<int>(ThresholdMode::Manual) &&
+        !(_debug_mode && _debug_level == 0))
+    {
+        defines["BLUR_FILTER"] = _blur ? "1" : "0";
+        defines["BLUR_MODE"] = std::to_string(_blur ? _blur_mode : static_cast<int>(BlurMode::Gaussian));
+        defines["BINARY_IMAGE"] = _debug_mode ? "1" : "0";
+        _shaderFused = variant("shaders/preprocess.comp.glsl", defines);
+        // step 1+2: grayscale, blur and threshold in one pass
+        glUseProgram(_shaderFused->program());
+        glBindTextureUnit(0, sourceImg);
+        glBindImageTexture(1, _texBinary, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8_SNORM);
+        glBindImageTexture(2, _texPacked, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+        _shaderFused->uniformInt("imageIn", 0);
+        _shaderFused->uniformInt("shades", _gray_shades);
+        _shaderFused->uniformFloat("blurRadius", _blur_radius);
+        _shaderFused->uniformFloat("blurQuality", _blur_quality);
+        _shaderFused->uniformFloat("blurDirections", _blur_directions);
+        _shaderFused->uniformInt("gaussRadius", _gauss_radius);
+        _shaderFused->uniformFloatArray("gaussWeights", _gauss_weights, BLUR_MAX_RADIUS + 1);
+        _shaderFused->uniformFloat("threshold", _threshold);
+        _shaderFused->uniformIVec2("roiOrigin", roiOrigin);
+        glDispatchCompute(
+            static_cast<GLuint>(groupX),
+            static_cast<GLuint>(groupY), 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        glBindTextureUnit(0, 0);
+        _lastTex = _texBinary;
+        if(_debug_mode && _debug_level == 1) return;
+        readback();
+        return;
+    }
     // step 1: convert rgb image to grayscale
+    // gaussian blur and quantization follow as separate passes
+    defines["BLUR_FILTER"] = _blur && !gaussian ? "1" : "0";
+    if(gaussian) defines["QUANTIZE"] = "0";
+    _shader1 = variant("shaders/grayscale.comp.glsl", defines);
     glUseProgram(_shader1->program());
-    glBindImageTexture(0, sourceImg,  0, GL_FALSE, 0, GL_READ_ONLY,  GL_RGBA32F);
-    glBindImageTexture(1, fetchTex(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTextureUnit(0, sourceImg);
+    glBindImageTexture(1, _texGray, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+    _shader1->uniformInt("imageIn", 0);
     _shader1->uniformInt("shades", _gray_shades);
-    _shader1->uniformBool("blurFilter", _blur);
     _shader1->uniformFloat("blurRadius", _blur_radius);
     _shader1->uniformFloat("blurQuality", _blur_quality);
     _shader1->uniformFloat("blurDirections", _blur_directions);
+    // separable gaussian reads its radius around the ROI, that border has to be fresh too
+    glm::ivec4 grayRegion = gaussian ? growROI(_gauss_radius) : _roi;
+    _shader1->uniformIVec2("roiOrigin", glm::ivec2(grayRegion.x, grayRegion.y));
     glDispatchCompute(
-        static_cast<GLuint>(groupX),
-        static_cast<GLuint>(groupY), 1);
+        static_cast<GLuint>((grayRegion.z - grayRegion.x + 31) / 32),
+        static_cast<GLuint>((grayRegion.w - grayRegion.y + 31) / 32), 1);
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindTextureUnit(0, 0);
+    if(gaussian) blurSeparable();
+    _lastTex = _texGray;
     if(_debug_mode && _debug_level == 0) 
     {
-        glGenerateTextureMipmap(lastTex());
+        glGenerateTextureMipmap(_texGray);
         return;
     }
     // step 2: convert grayscale to black-white
-    if(_auto_threshold)
-    {
-        // set threshold as the average (top level of mipmap) value
-        glGenerateTextureMipmap(lastTex());
-        glGetTextureImage(lastTex(), _auto_threshold_level-1, GL_RED, GL_FLOAT, sizeof(float), &_threshold);
-    }
+    bool adaptive = _threshold_mode == static_cast<int>(ThresholdMode::Adaptive);
+    bool global = _threshold_mode == static_cast<int>(ThresholdMode::Global);
+    bool otsu = _threshold_mode == static_cast<int>(ThresholdMode::Otsu);
+    collectThreshold();
+    if(global) computeMean(groupX, groupY);
+    else if(otsu) computeOtsu(groupX, groupY);
+    else if(adaptive) computeTileMeans();
+    _shader2 = variant("shaders/threshold.comp.glsl", {{"BINARY_IMAGE", _debug_mode ? "1" : "0"}});
     glUseProgram(_shader2->program());
-    glBindImageTexture(0, lastTex(),  0, GL_FALSE, 0, GL_READ_ONLY,  GL_R32F);
-    glBindImageTexture(1, fetchTex(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindImageTexture(0, _texGray,   0, GL_FALSE, 0, GL_READ_ONLY,  GL_R8);
+    glBindImageTexture(1, _texBinary, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8_SNORM);
+    glBindImageTexture(2, _texPacked, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _sumBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _histBuffer);
     _shader2->uniformFloat("threshold", _threshold);
+    _shader2->uniformBool("otsu", otsu);
+    _shader2->uniformBool("globalMean", global);
+    _shader2->uniformInt("meanPixels", (_roi.z - _roi.x) * (_roi.w - _roi.y));
+    _shader2->uniformIVec2("roiOrigin", roiOrigin);
+    _shader2->uniformBool("adaptive", adaptive);
+    if(adaptive)
+    {
+        glBindTextureUnit(2, _texMeans);
+        _shader2->uniformInt("means", 2);
+        _shader2->uniformInt("tileSize", _means_tile);
+        _shader2->uniformFloat("offset", _adaptive_offset);
+    }
     glDispatchCompute(
         static_cast<GLuint>(groupX),
         static_cast<GLuint>(groupY), 1);
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    if(_debug_mode && _debug_level == 1) 
+    if(adaptive) glBindTextureUnit(2, 0);
+    _lastTex = _texBinary;
+    if(_debug_mode && _debug_level == 1) return;
+    readback();
+}
+
+std::shared_ptr<Shader> Marker::variant(const std::string& source, const ShaderDefines& defines)
+{
+    std::shared_ptr<Shader>& shader = _variants[ShaderCache::key({{source, GL_COMPUTE_SHADER}}, defines)];
+    if(!shader) shader = ShaderCache::compute(source, defines);
+    return shader;
+}
+
+void Marker::enableCPU(std::shared_ptr<ThreadPool> pool)
+{
+    _cpu.reset(new CpuPreprocessor(_width, _height, pool));
+}
+
+void Marker::preprocess(const cv::Mat& frame)
+{
+    if(!_cpu) enableCPU(nullptr);
+    _detect_pending = false;
+    _cpu_frame = true;
+    _roi = glm::ivec4(0, 0, _width, _height);
+    // directional blur has no CPU version, gaussian is used for both modes
+    if(_blur) updateGaussWeights();
+    _cpu->setBlur(_blur ? _gauss_radius : 0, _gauss_weights);
+    bool manual = _threshold_mode == static_cast<int>(ThresholdMode::Manual);
+    _threshold = _cpu->process(frame, manual ? _threshold : -1.0f, _gray_shades, _image_bits);
+    _detect_pending = true;
+}
+
+void Marker::updateGaussWeights()
+{
+    if(_gauss_sigma == _blur_sigma) return;
+    _gauss_sigma = _blur_sigma;
+    // 3 sigma covers 99.7% of the kernel
+    _gauss_radius = std::min(BLUR_MAX_RADIUS, static_cast<int>(std::ceil(3.0f * _blur_sigma)));
+    float sum = 0.0f;
+    for(int i = 0; i <= BLUR_MAX_RADIUS; i++)
     {
-        glGenerateTextureMipmap(lastTex());
+        _gauss_weights[i] = i <= _gauss_radius ?
+            std::exp(-static_cast<float>(i * i) / (2.0f * _blur_sigma * _blur_sigma)) : 0.0f;
+        sum += i ? 2.0f * _gauss_weights[i] : _gauss_weights[i];
+    }
+    for(int i = 0; i <= BLUR_MAX_RADIUS; i++) _gauss_weights[i] /= sum;
+}
+
+void Marker::blurSeparable()
+{
+    // rows: gray -> blur, columns: blur -> gray, 256 pixel line segments per group
+    // rows pass covers radius rows above and below the ROI, read by columns pass
+    glm::ivec4 rows = growROI(_gauss_radius);
+    int roiWidth = _roi.z - _roi.x, roiHeight = _roi.w - _roi.y;
+    glUseProgram(_shaderBlur->program());
+    _shaderBlur->uniformIVec2("roiOrigin", glm::ivec2(_roi.x, rows.y));
+    _shaderBlur->uniformInt("radius", _gauss_radius);
+    _shaderBlur->uniformFloatArray("weights", _gauss_weights, BLUR_MAX_RADIUS + 1);
+    glBindImageTexture(0, _texGray, 0, GL_FALSE, 0, GL_READ_ONLY,  GL_R8);
+    glBindImageTexture(1, _texBlur, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+    _shaderBlur->uniformBool("vertical", false);
+    _shaderBlur->uniformInt("shades", 1);
+    glDispatchCompute(static_cast<GLuint>((roiWidth + 255) / 256), static_cast<GLuint>(rows.w - rows.y), 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    _shaderBlur->uniformIVec2("roiOrigin", glm::ivec2(_roi.x, _roi.y));
+    glBindImageTexture(0, _texBlur, 0, GL_FALSE, 0, GL_READ_ONLY,  GL_R8);
+    glBindImageTexture(1, _texGray, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+    _shaderBlur->uniformBool("vertical", true);
+    _shaderBlur->uniformInt("shades", _gray_shades);
+    glDispatchCompute(static_cast<GLuint>((roiHeight + 255) / 256), static_cast<GLuint>(roiWidth), 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void Marker::collectThreshold()
+{
+    // previous level arrived: show it as threshold, never wait for it
+    if(!_sum_fence) return;
+    GLenum status = glClientWaitSync(_sum_fence, 0, 0);
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+    if(_sum_mode == static_cast<int>(ThresholdMode::Global))
+        _threshold = static_cast<float>(*_sum_mapped) / (255.0f * _sum_pixels);
+    else
+        std::memcpy(&_threshold, _sum_mapped, sizeof(float));
+    glDeleteSync(_sum_fence);
+    _sum_fence = nullptr;
+}
+
+void Marker::readThreshold(GLuint buffer, GLintptr offset)
+{
+    if(_sum_fence || !_sum_mapped) return;
+    glCopyNamedBufferSubData(buffer, _sumReadback, offset, 0, sizeof(uint32_t));
+    _sum_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _sum_mode = _threshold_mode;
+    _sum_pixels = (_roi.z - _roi.x) * (_roi.w - _roi.y);
+}
+
+void Marker::computeMean(int groupX, int groupY)
+{
+    // threshold kernel reads the sum straight from the buffer
+    glClearNamedBufferData(_sumBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glUseProgram(_shaderMean->program());
+    _shaderMean->uniformIVec2("roiOrigin", glm::ivec2(_roi.x, _roi.y));
+    glBindImageTexture(0, _texGray, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R8);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _sumBuffer);
+    glDispatchCompute(
+        static_cast<GLuint>(groupX),
+        static_cast<GLuint>(groupY), 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    readThreshold(_sumBuffer, 0);
+}
+
+void Marker::computeOtsu(int groupX, int groupY)
+{
+    // histogram and level stay on GPU, threshold kernel reads the level from the buffer
+    glClearNamedBufferData(_histBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glUseProgram(_shaderHist->program());
+    _shaderHist->uniformIVec2("roiOrigin", glm::ivec2(_roi.x, _roi.y));
+    glBindImageTexture(0, _texGray, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R8);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _histBuffer);
+    glDispatchCompute(
+        static_cast<GLuint>(groupX),
+        static_cast<GLuint>(groupY), 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(_shaderOtsu->program());
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    readThreshold(_histBuffer, 256 * sizeof(uint32_t));
+}
+
+void Marker::computeTileMeans()
+{
+    int tile = std::max(16, _adaptive_tile / 16 * 16);
+    int tilesX = (_width + tile - 1) / tile, tilesY = (_height + tile - 1) / tile;
+    if(tile != _means_tile)
+    {
+        // immutable storage, recreate when tile size changes
+        if(_texMeans) glDeleteTextures(1, &_texMeans);
+        glGenTextures(1, &_texMeans);
+        glBindTexture(GL_TEXTURE_2D, _texMeans);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R16F, tilesX, tilesY);
+        // bilinear sampling between tile centers avoids seams at tile borders
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        _means_tile = tile;
+    }
+    glUseProgram(_shaderMeans->program());
+    glBindImageTexture(0, _texGray,  0, GL_FALSE, 0, GL_READ_ONLY,  GL_R8);
+    glBindImageTexture(1, _texMeans, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
+    _shaderMeans->uniformInt("tileSize", tile);
+    glDispatchCompute(static_cast<GLuint>(tilesX), static_cast<GLuint>(tilesY), 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void Marker::readback()
+{
+    // step 3: read back packed binary image for contour tracking on CPU (1 bit per pixel)
+    size_t bytes = _image_bits.size() * sizeof(uint32_t);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    if(!_async_readback || !_readback_ptr)
+    {
+        for(GLsync& fence : _readback_fence)
+        {
+            if(fence) glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if(_roi == glm::ivec4(0, 0, _width, _height))
+        {
+            glGetTextureImage(_texPacked, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, bytes, _image_bits.data());
+            _detect_pending = true;
+            return;
+        }
+        // only words of the ROI rows, rest of the image is white (no contours)
+        std::fill(_image_bits.begin(), _image_bits.end(), ~0u);
+        int word = _roi.x / 32, words = (_roi.z + 31) / 32 - word;
+        size_t offset = static_cast<size_t>(_roi.y) * _packed_width + word;
+        glPixelStorei(GL_PACK_ROW_LENGTH, _packed_width);
+        glGetTextureSubImage(_texPacked, 0, word, _roi.y, 0, words, _roi.w - _roi.y, 1,
+            GL_RED_INTEGER, GL_UNSIGNED_INT, static_cast<GLsizei>(bytes - offset * sizeof(uint32_t)),
+            _image_bits.data() + offset);
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        _detect_pending = true;
         return;
     }
-    // step 3: contour tracking on CPU
-    glGetTextureImage(lastTex(), 0, GL_RED, GL_BYTE, _image_data.size() * sizeof(int8_t), _image_data.data());
+    // queue this frame without waiting
+    int slot = _readback_slot;
+    if(_readback_fence[slot]) glDeleteSync(_readback_fence[slot]);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _readbackPBO);
+    glGetTextureImage(_texPacked, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, static_cast<GLsizei>(bytes),
+        reinterpret_cast<void*>(bytes * slot));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _readback_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _readback_slot = 1 - slot;
+    // previous frame was queued a frame ago, normally already done
+    GLsync& previous = _readback_fence[_readback_slot];
+    if(!previous) return;
+    GLenum status = glClientWaitSync(previous, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    glDeleteSync(previous);
+    previous = nullptr;
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+    std::memcpy(_image_bits.data(), _readback_ptr + bytes * _readback_slot, bytes);
+    _detect_pending = true;
+}
+
+static int count_trailing_zeros(uint32_t bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+void Marker::detect()
+{
+    if(!_detect_pending) return;
+    _detect_pending = false;
     bool markerFound = false;
-    for(int y = 1; (y < _height - 1) && !markerFound; y+=_image_scan_step)
+    std::fill(_visited.begin(), _visited.end(), 0u);
+    // rows outside the ROI were not read back
+    int scanStep = std::max(1, std::min(_image_scan_step, (_roi.w - _roi.y) / 8));
+    int scanEnd = std::min(_height - 1, _roi.w);
+    for(int y = std::max(1, _roi.y); (y < scanEnd) && !markerFound; y+=scanStep)
     {
         // image memory starts from bottom left
-        for(int x = 2; (x < _width - 1) && !markerFound; x++)
+        const uint32_t* row = &_image_bits[y * _packed_width];
+        uint32_t carry = 0;
+        for(int i = 0; (i < _packed_width) && !markerFound; i++)
         {
-            // initial values: white -> 127, black -> -127, visited -> 0
-            int8_t cNow = _image_data[x + y * _width];
-            if(cNow >= 0) continue;
-            int8_t cPrev = _image_data[x + y * _width - 1];
-            if(cPrev > 0 && cNow < 0)
+            // unvisited black pixels right of a white pixel, 32 at a time
+            uint32_t bits = row[i];
+            uint32_t edges = ~bits & ((bits << 1) | carry);
+            carry = bits >> 31;
+            while(edges && !markerFound)
+            {
+                int x = i * 32 + count_trailing_zeros(edges);
+                edges &= edges - 1;
+                // visited bits change while tracing, check them per pixel
+                if(x < 2 || x >= _width - 1 || visited(x, y)) continue;
                 markerFound = follow_contour(x, y);
+            }
         }
     }
-    // step4: update VBO
+    // step 4: track marker state, VBO is updated in finish()
+    if(!markerFound)
+    {
+        _tracked_frames = 0;
+        _refine_pending = false;
+    }
     if(markerFound) 
     {
-        update_corners();
+        // unchanged corners stay pending until a matching full resolution frame came
+        _refine_pending = _refine_pending || _new_marker;
+        _corners_dirty = true;
         _marker_not_found = 0;
+        _tracked_frames++;
+        updateROI();
     }
     else if(_marker_borderp1p2.x >= 0.0f && _marker_not_found > 20)
     {
@@ -124,7 +523,7 @@ void Marker::process(GLuint sourceImg, int groupX, int groupY)
         _marker_borderp1p2 = glm::vec4(0.0f);
         _marker_borderp3p4 = glm::vec4(0.0f);
         _poseMRefined = glm::mat4x3(0.0f);
-        update_corners();
+        _corners_dirty = true;
     }
     else if(_marker_not_found < 30)
     {
@@ -132,6 +531,115 @@ void Marker::process(GLuint sourceImg, int groupX, int groupY)
     }
 }
 
+void Marker::refineCorners(const cv::Mat& frame, PixelFormat format)
+{
+    if(!_refine_pending || !_refine_corners) return;
+    // MJPG: color of this frame not decoded yet (compressed frames cannot be read),
+    // corners are refined on a later frame
+    if(frame.empty() || format == PixelFormat::JPEG) return;
+    _refine_pending = false;
+    // async readback traced the previous frame
+    if(_async_readback) return;
+    int width = frame.cols;
+    int height = format == PixelFormat::NV12 ? frame.rows * 2 / 3 : frame.rows;
+    // luma of capture frame, rows bottom-up like the detection image
+    auto luma = [&](int x, int y) -> float
+    {
+        const uint8_t* row = frame.ptr<uint8_t>(height - 1 - y);
+        switch(format)
+        {
+            case PixelFormat::BGR:
+                return 0.114f * row[x * 3] + 0.587f * row[x * 3 + 1] + 0.299f * row[x * 3 + 2];
+            case PixelFormat::YUYV: return row[x * 2];
+            default:                return row[x];
+        }
+    };
+    // traced corners are only exact to one detection pixel
+    int half = static_cast<int>(std::ceil(_image_scale)) + 2;
+    glm::vec2 corners[4] = {
+        glm::vec2(_marker_borderp1p2.x, _marker_borderp1p2.y),
+        glm::vec2(_marker_borderp1p2.z, _marker_borderp1p2.w),
+        glm::vec2(_marker_borderp3p4.x, _marker_borderp3p4.y),
+        glm::vec2(_marker_borderp3p4.z, _marker_borderp3p4.w)
+    };
+    for(glm::vec2& corner : corners)
+    {
+        glm::vec2 start = captureCoords(corner);
+        glm::vec2 q = start;
+        bool valid = true;
+        for(int iter = 0; iter < 5 && valid; iter++)
+        {
+            int cx = static_cast<int>(std::round(q.x));
+            int cy = static_cast<int>(std::round(q.y));
+            if(cx - half < 1 || cy - half < 1 || cx + half >= width - 1 || cy + half >= height - 1)
+            {
+                valid = false;
+                break;
+            }
+            // gradients around a corner are orthogonal to (p - q):
+            // solve sum(g g^T) q = sum(g g^T p)
+            float a = 0.0f, b = 0.0f, c = 0.0f, bx = 0.0f, by = 0.0f;
+            for(int y = cy - half; y <= cy + half; y++)
+            {
+                for(int x = cx - half; x <= cx + half; x++)
+                {
+                    float gx = (luma(x + 1, y) - luma(x - 1, y)) * 0.5f;
+                    float gy = (luma(x, y + 1) - luma(x, y - 1)) * 0.5f;
+                    a += gx * gx;
+                    b += gx * gy;
+                    c += gy * gy;
+                    bx += gx * gx * x + gx * gy * y;
+                    by += gx * gy * x + gy * gy * y;
+                }
+            }
+            // flat area or straight edge, no unique point
+            float det = a * c - b * b;
+            if(det <= 1e-4f * (a + c) * (a + c))
+            {
+                valid = false;
+                break;
+            }
+            glm::vec2 next((c * bx - b * by) / det, (a * by - b * bx) / det);
+            float moved = glm::length(next - q);
+            q = next;
+            if(glm::length(q - start) > half) valid = false;
+            if(moved < 0.01f) break;
+        }
+        // pose estimation maps corners to capture pixels again
+        if(valid) corner = detectCoords(q);
+    }
+    _marker_borderp1p2 = glm::vec4(corners[0], corners[1]);
+    _marker_borderp3p4 = glm::vec4(corners[2], corners[3]);
+}
+
+glm::ivec4 Marker::growROI(int margin) const
+{
+    glm::ivec2 start = glm::max(glm::ivec2(_roi.x, _roi.y) - margin, glm::ivec2(0)) / 32 * 32;
+    glm::ivec2 end = glm::min(glm::ivec2(_roi.z, _roi.w) + margin, glm::ivec2(_width, _height));
+    return glm::ivec4(start, end);
+}
+
+void Marker::updateROI()
+{
+    glm::vec2 p1(_marker_borderp1p2.x, _marker_borderp1p2.y), p2(_marker_borderp1p2.z, _marker_borderp1p2.w);
+    glm::vec2 p3(_marker_borderp3p4.x, _marker_borderp3p4.y), p4(_marker_borderp3p4.z, _marker_borderp3p4.w);
+    glm::vec2 lo = glm::min(glm::min(p1, p2), glm::min(p3, p4));
+    glm::vec2 hi = glm::max(glm::max(p1, p2), glm::max(p3, p4));
+    // half the marker size on every side covers motion until next frame
+    glm::vec2 pad = glm::max((hi - lo) * 0.5f, glm::vec2(16.0f));
+    glm::ivec2 start = glm::max(glm::ivec2(glm::floor(lo - pad)), glm::ivec2(0)) / 32 * 32;
+    glm::ivec2 end = (glm::ivec2(glm::ceil(hi + pad)) + 31) / 32 * 32;
+    end = glm::min(end, glm::ivec2(_width, _height));
+    _roi_next = glm::ivec4(start, end);
+}
+
+void Marker::finish()
+{
+    if(!_corners_dirty) return;
+    if(_gpu) update_corners();
+    _corners_dirty = false;
+}
+
 void rotate_90(glm::ivec2& dir)
 {
     // rotate 90 degrees clock wise
@@ -186,33 +694,30 @@ bool Marker::follow_contour(int x, int y)
         p2 = pCurr + dirForward;
         p1 = pCurr + dirForward - dirRight;
         p3 = pCurr + dirForward + dirRight;
-        int8_t& p1Val = _image_data[p1.x + p1.y * _width];
-        int8_t& p2Val = _image_data[p2.x + p2.y * _width];
-        int8_t& p3Val = _image_data[p3.x + p3.y * _width];
-        if(p1Val <= 0)
+        if(!white(p1.x, p1.y))
         {
             // if p1 is black
             track.push_back(glm::vec2(p1));
             pCurr = p1;
             rotate_neg90(dirForward);
             rotate_neg90(dirRight);
-            p1Val = 0;
+            visit(p1);
             rotationCounter = 0;
         }
-        else if(p2Val <= 0)
+        else if(!white(p2.x, p2.y))
         {
             // if p2 is black
             track.push_back(glm::vec2(p2));
             pCurr = p2;
-            p2Val = 0;
+            visit(p2);
             rotationCounter = 0;
         }
-        else if(p3Val <= 0)
+        else if(!white(p3.x, p3.y))
         {
             // if p3 is black
             track.push_back(glm::vec2(p3));
             pCurr = p3;
-            p3Val = 0;
+            visit(p3);
             rotationCounter = 0;
         }
         else if(rotationCounter >= 3)
@@ -420,7 +925,7 @@ bool Marker::fit_quadrilateral(std::vector<glm::vec2>& track)
     glm::ivec2 sampleP2 = glm::ivec2(glm::round((track[p2] + centeroid) * 0.5f));
     glm::ivec2 sampleP3 = glm::ivec2(glm::round((track[p3] + centeroid) * 0.5f));
     glm::ivec2 sampleP4 = glm::ivec2(glm::round((track[p4] + centeroid) * 0.5f));
-    if(_image_data[sampleP2.x + sampleP2.y * _width] <= 0)
+    if(!white(sampleP2.x, sampleP2.y))
     {
         // if P2 is near black area
         int tmp = p1;
@@ -429,7 +934,7 @@ bool Marker::fit_quadrilateral(std::vector<glm::vec2>& track)
         p4 = p3;
         p3 = tmp;
     }
-    else if(_image_data[sampleP3.x + sampleP3.y * _width] <= 0)
+    else if(!white(sampleP3.x, sampleP3.y))
     {
         // if P3 is near black area
         int tmp = p1;
@@ -438,7 +943,7 @@ bool Marker::fit_quadrilateral(std::vector<glm::vec2>& track)
         p4 = p2;
         p2 = tmp;
     }
-    else if(_image_data[sampleP4.x + sampleP4.y * _width] <= 0)
+    else if(!white(sampleP4.x, sampleP4.y))
     {
         // if P4 is near black area
         int tmp = p1;
@@ -509,7 +1014,7 @@ void Marker::update_corners()
 
 void Marker::drawCorners(float ratioCon, float ratioCam)
 {
-    if(_debug_mode && _debug_level == 2)
+    if(_gpu && _debug_mode && _debug_level == 2)
     {
         glUseProgram(_shaderDraw->program());
         _shaderDraw->uniformFloat("ratio_img", ratioCam);
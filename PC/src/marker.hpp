@@ -4,7 +4,36 @@
 #include <memory>
 #include <vector>
 #include <random>
+#include <cstdint>
+#include <map>
+#include <string>
 #include "shader.hpp"
+#include "framesource.hpp"
+#include "cpupreprocess.hpp"
+
+// largest separable blur radius, matches HALO / MAX_RADIUS in shaders
+#define BLUR_MAX_RADIUS 10
+// consecutive detections before preprocessing is restricted to the tracking ROI
+#define ROI_TRACKED_FRAMES 3
+
+enum class BlurMode
+{
+    // samples along rays around each pixel (original filter)
+    Directional = 0,
+    // separable gaussian, two 1D passes
+    Gaussian = 1,
+};
+
+enum class ThresholdMode
+{
+    Manual = 0,
+    // mean of the whole image
+    Global = 1,
+    // mean of surrounding tiles, robust to uneven lighting
+    Adaptive = 2,
+    // level separating luma histogram into two classes best (black marker on bright scene)
+    Otsu = 3,
+};
 
 struct BoxData
 {
@@ -29,10 +58,31 @@ private:
 class Marker
 {
 public:
-    Marker(int width, int height);
+    // without gpu no GL object is created, only CPU preprocessing can be used
+    Marker(int width, int height, bool gpu = true);
     ~Marker();
 
-    void process(GLuint sourceImg, int groupX, int groupY);
+    // preprocess + detect + finish
+    void process(GLuint sourceImg, int groupX, int groupY,
+        LumaLayout luma = LumaLayout::RGB, int sampleScale = 1);
+    // GL thread: grayscale, threshold and read back binary image
+    // sampleScale x sampleScale source pixels are averaged into one detection pixel
+    void preprocess(GLuint sourceImg, int groupX, int groupY,
+        LumaLayout luma = LumaLayout::RGB, int sampleScale = 1);
+    // calling thread: same steps on CPU from an 8-bit BGR frame of detection size
+    // (gaussian blur only, adaptive and Otsu threshold fall back to global mean)
+    void preprocess(const cv::Mat& frame);
+    // split CPU preprocessing rows across pool
+    void enableCPU(std::shared_ptr<ThreadPool> pool);
+    // any thread: contour tracking on read back image, touches only this marker
+    // (pose estimation can follow on the same thread)
+    void detect();
+    // same thread after detect(): move corners of a newly found marker to subpixel
+    // positions on the capture frame (BGR, YUYV or NV12, has to match the detection,
+    // empty if not available yet)
+    void refineCorners(const cv::Mat& frame, PixelFormat format);
+    // GL thread: upload detected corners for drawing
+    void finish();
     void drawCorners(float ratioCon, float ratioCam);
     void estimatePoseSVD(
         const glm::mat3& cameraK, const glm::mat3& cameraInvK,
@@ -47,16 +97,15 @@ public:
         const glm::vec3& cameraDistK, const glm::vec2& cameraDistP
     );
 
-    // fetch texture and update index
-    GLuint fetchTex()
-    {
-        GLuint tex = _tex[_currentTex];
-        _currentTex = !_currentTex;
-        return tex;
-    }
-    // only get current texture
-    GLuint lastTex() {return _tex[!_currentTex];}
-    bool debug() {return _debug_mode && _debug_level < 2;}
+    // compile (or fetch cached) programs used by every marker
+    // holding the result keeps them alive, e.g. while cameras are still opening
+    static std::vector<std::shared_ptr<Shader>> loadShaders();
+
+    // only get last written texture
+    GLuint lastTex() {return _lastTex;}
+    bool debug() {return _debug_mode && _debug_level < 2 && !_cpu_frame;}
+    // capture pixels per detection pixel, corners are scaled back for pose estimation
+    void setImageScale(float scale) {_image_scale = scale;}
     glm::mat4x3 poseM() {return _poseMRefined;}
 
     void UI();
@@ -64,23 +113,85 @@ public:
 
 private:
     int _width, _height;
-    GLuint _tex[2];
-    int _currentTex = 0;
+    bool _gpu;
+    // CPU preprocessing, last frame went through it (debug textures are not written)
+    std::unique_ptr<CpuPreprocessor> _cpu;
+    bool _cpu_frame = false;
+    float _image_scale = 1.0f;
+    // grayscale (R8 with mipmaps for auto threshold) and binary (R8 snorm) images
+    // blur image holds the horizontal gaussian pass of unfused path
+    // means holds one value per adaptive threshold tile (R16F)
+    GLuint _texGray, _texBinary, _texBlur;
+    // packed binary image (R32UI), read back instead of the snorm image
+    GLuint _texPacked;
+    GLuint _texMeans = 0;
+    int _means_tile = 0;
+    // global mean: luma sum on GPU, Otsu: histogram followed by level
+    GLuint _sumBuffer, _histBuffer;
+    // threshold chosen on GPU, copied to mapped memory and shown a frame later
+    GLuint _sumReadback;
+    const uint32_t* _sum_mapped = nullptr;
+    GLsync _sum_fence = nullptr;
+    int _sum_mode = 0;
+    // pixels behind the luma sum in flight (whole image or ROI)
+    int _sum_pixels = 1;
+    GLuint _lastTex;
+    // grayscale, threshold and fused programs are variants picked per frame
+    // from blur, quantization and debug settings, every variant used is kept here
+    std::map<std::string, std::shared_ptr<Shader>> _variants;
     std::shared_ptr<Shader> _shader1, _shader2, _shaderDraw;
+    // grayscale + blur + threshold in one pass, skips the grayscale image
+    std::shared_ptr<Shader> _shaderFused;
+    std::shared_ptr<Shader> _shaderBlur;
+    std::shared_ptr<Shader> _shaderMeans;
+    std::shared_ptr<Shader> _shaderMean;
+    std::shared_ptr<Shader> _shaderHist, _shaderOtsu;
 
     // variables for preprocessing image
+    bool _fused = true;
     int _gray_shades = 1;
     bool _blur = false;
     float _blur_radius = 5.0f, _blur_quality = 6.0f, _blur_directions = 12.0f;
+    int _blur_mode = static_cast<int>(BlurMode::Gaussian);
+    float _blur_sigma = 2.0f;
+    // weights of current sigma, recomputed when it changes
+    float _gauss_sigma = 0.0f;
+    int _gauss_radius = 0;
+    float _gauss_weights[BLUR_MAX_RADIUS + 1];
     float _threshold = 0.5f;
-    bool _auto_threshold = false;
+    int _threshold_mode = static_cast<int>(ThresholdMode::Manual);
     int _auto_threshold_level = 0;
+    // adaptive: tile edge (multiple of 16) and offset below local mean
+    int _adaptive_tile = 32;
+    float _adaptive_offset = 0.05f;
     // variables for closed contour detection
-    std::vector<int8_t> _image_data;
+    // binary image packed 32 pixels per word (bit set if white), rows of _packed_width words
+    // visited bitmap has the same layout, only black pixels get visited
+    std::vector<uint32_t> _image_bits;
+    std::vector<uint32_t> _visited;
+    int _packed_width;
+    // async readback: packed image copied into one of two mapped PBO slots,
+    // frame N is traced while the GPU preprocesses frame N+1 (one frame latency)
+    bool _async_readback = false;
+    GLuint _readbackPBO;
+    const uint8_t* _readback_ptr = nullptr;
+    GLsync _readback_fence[2] = {nullptr, nullptr};
+    int _readback_slot = 0;
     int _image_scan_step;
+    // tracking ROI (x0, y0, x1, y1), group aligned: while the marker is found in consecutive
+    // frames only a padded box around its corners is preprocessed, read back and scanned
+    bool _roi_tracking = true;
+    int _tracked_frames = 0;
+    // region of current frame and box around last corners (set by detect)
+    glm::ivec4 _roi, _roi_next;
     glm::vec4 _marker_borderp1p2;
     glm::vec4 _marker_borderp3p4;
     bool _new_marker = false;
+    bool _detect_pending = false;
+    bool _corners_dirty = false;
+    // corner refinement on full resolution frame, pending after a new detection
+    bool _refine_corners = true;
+    bool _refine_pending = false;
     int _tracing_max_iter = 5000;
     int _tracing_thres_contour = 200;
     float _tracing_thres_quadra = 6.0f;
@@ -96,6 +207,40 @@ private:
     int _debug_level = 0;
     bool _debug_mode = false;
 
+    // compute program compiled with defines, kept alive in _variants
+    std::shared_ptr<Shader> variant(const std::string& source, const ShaderDefines& defines);
+    void readback();
+    void updateROI();
+    // ROI grown by margin on every side, group aligned and clamped to the image
+    glm::ivec4 growROI(int margin) const;
+    void updateGaussWeights();
+    void blurSeparable();
+    void computeTileMeans();
+    void computeMean(int groupX, int groupY);
+    void computeOtsu(int groupX, int groupY);
+    void collectThreshold();
+    void readThreshold(GLuint buffer, GLintptr offset);
+    bool white(int x, int y) const
+    {
+        return (_image_bits[y * _packed_width + (x >> 5)] >> (x & 31)) & 1u;
+    }
+    bool visited(int x, int y) const
+    {
+        return (_visited[y * _packed_width + (x >> 5)] >> (x & 31)) & 1u;
+    }
+    void visit(const glm::ivec2& p)
+    {
+        _visited[p.y * _packed_width + (p.x >> 5)] |= 1u << (p.x & 31);
+    }
+    // detection pixel p covers capture pixels [p * s, p * s + s - 1], centers map onto each other
+    glm::vec2 captureCoords(const glm::vec2& p) const
+    {
+        return p * _image_scale + glm::vec2((_image_scale - 1.0f) * 0.5f);
+    }
+    glm::vec2 detectCoords(const glm::vec2& p) const
+    {
+        return (p - glm::vec2((_image_scale - 1.0f) * 0.5f)) / _image_scale;
+    }
     bool follow_contour(int x, int y);
     bool fit_quadrilateral(std::vector<glm::vec2>& track);
     void update_corners();
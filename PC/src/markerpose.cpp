@@ -487,10 +487,10 @@ void Marker::estimatePoseSVD(
         return;
     }
     // prepare p
-    glm::vec2 p1 = glm::vec2(_marker_borderp1p2.x, _marker_borderp1p2.y);
-    glm::vec2 p2 = glm::vec2(_marker_borderp1p2.z, _marker_borderp1p2.w);
-    glm::vec2 p3 = glm::vec2(_marker_borderp3p4.x, _marker_borderp3p4.y);
-    glm::vec2 p4 = glm::vec2(_marker_borderp3p4.z, _marker_borderp3p4.w);
+    glm::vec2 p1 = captureCoords(glm::vec2(_marker_borderp1p2.x, _marker_borderp1p2.y));
+    glm::vec2 p2 = captureCoords(glm::vec2(_marker_borderp1p2.z, _marker_borderp1p2.w));
+    glm::vec2 p3 = captureCoords(glm::vec2(_marker_borderp3p4.x, _marker_borderp3p4.y));
+    glm::vec2 p4 = captureCoords(glm::vec2(_marker_borderp3p4.z, _marker_borderp3p4.w));
     // undistort points
     undistortPoints(
         cameraK, cameraDistK, cameraDistP,
@@ -562,10 +562,10 @@ void Marker::estimatePoseLinear(
         return;
     }
     // prepare p
-    glm::vec2 p1 = glm::vec2(_marker_borderp1p2.x, _marker_borderp1p2.y);
-    glm::vec2 p2 = glm::vec2(_marker_borderp1p2.z, _marker_borderp1p2.w);
-    glm::vec2 p3 = glm::vec2(_marker_borderp3p4.x, _marker_borderp3p4.y);
-    glm::vec2 p4 = glm::vec2(_marker_borderp3p4.z, _marker_borderp3p4.w);
+    glm::vec2 p1 = captureCoords(glm::vec2(_marker_borderp1p2.x, _marker_borderp1p2.y));
+    glm::vec2 p2 = captureCoords(glm::vec2(_marker_borderp1p2.z, _marker_borderp1p2.w));
+    glm::vec2 p3 = captureCoords(glm::vec2(_marker_borderp3p4.x, _marker_borderp3p4.y));
+    glm::vec2 p4 = captureCoords(glm::vec2(_marker_borderp3p4.z, _marker_borderp3p4.w));
     // undistort points
     undistortPoints(
         cameraK, cameraDistK, cameraDistP,
@@ -625,11 +625,15 @@ void Marker::estimatePoseOpenCV(
         _poseMRefined = glm::mat4x3(0.0f);
         return;
     }
+    glm::vec2 p1 = captureCoords(glm::vec2(_marker_borderp1p2.x, _marker_borderp1p2.y));
+    glm::vec2 p2 = captureCoords(glm::vec2(_marker_borderp1p2.z, _marker_borderp1p2.w));
+    glm::vec2 p3 = captureCoords(glm::vec2(_marker_borderp3p4.x, _marker_borderp3p4.y));
+    glm::vec2 p4 = captureCoords(glm::vec2(_marker_borderp3p4.z, _marker_borderp3p4.w));
     std::vector<cv::Point2d> imgPoints = {
-        cv::Point2d(_marker_borderp1p2.x, _marker_borderp1p2.y),
-        cv::Point2d(_marker_borderp1p2.z, _marker_borderp1p2.w),
-        cv::Point2d(_marker_borderp3p4.x, _marker_borderp3p4.y),
-        cv::Point2d(_marker_borderp3p4.z, _marker_borderp3p4.w),
+        cv::Point2d(p1.x, p1.y),
+        cv::Point2d(p2.x, p2.y),
+        cv::Point2d(p3.x, p3.y),
+        cv::Point2d(p4.x, p4.y),
     };
     std::vector<cv::Point3d> objPoints = {
         cv::Point3d(-1.0, -1.0, 0.0),
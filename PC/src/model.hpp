@@ -16,6 +16,12 @@ public:
         const glm::mat4& cameraProj,
         float cameraRatio, float windowRatio
     ) = 0;
+    // capture size of the camera the model is rendered over
+    void setCameraSize(int camWidth, int camHeight)
+    {
+        _width = camWidth;
+        _height = camHeight;
+    }
 
 protected:
     std::shared_ptr<Shader> _shader;
@@ -0,0 +1,177 @@
+#include "outputrecorder.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+
+std::shared_ptr<FrameSink> FrameSink::create(const std::string& path, int width, int height, double fps)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot != std::string::npos && (slash == std::string::npos || slash < dot))
+    {
+        std::string ext = path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if(ext == "mp4" || ext == "avi" || ext == "mkv")
+            return std::make_shared<VideoFileSink>(path, width, height, fps);
+    }
+    return std::make_shared<ImageFileSink>(path);
+}
+
+VideoFileSink::VideoFileSink(const std::string& path, int width, int height, double fps)
+    : _path(path)
+{
+    bool avi = path.size() >= 4 && path.compare(path.size() - 4, 4, ".avi") == 0;
+    int fourcc = avi ? cv::VideoWriter::fourcc('M', 'J', 'P', 'G') : cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    if(!_writer.open(path, fourcc, fps, cv::Size(width, height)))
+        throw std::runtime_error("Failed to open video writer: " + path);
+}
+
+VideoFileSink::~VideoFileSink()
+{
+    _writer.release();
+}
+
+bool VideoFileSink::write(const cv::Mat& frame)
+{
+    _writer.write(frame);
+    return true;
+}
+
+bool ImageFileSink::write(const cv::Mat& frame)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%06u.png", _index++);
+    return cv::imwrite(_directory + name, frame);
+}
+
+OutputRecorder::OutputRecorder(std::shared_ptr<FrameSink> sink, int width, int height)
+    : _sink(sink), _width(width), _height(height), _captured(0), _written(0), _dropped(0)
+{
+    _frame_bytes = static_cast<size_t>(width) * height * 4;
+    for(int i = 0; i < OUTPUT_PBO_COUNT; i++) _pbo_fence[i] = nullptr;
+    // GL side is optional, frames can also be submitted directly
+    if(glewIsSupported("GL_VERSION_4_4"))
+    {
+        const GLbitfield pboFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &_pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, _frame_bytes * OUTPUT_PBO_COUNT, nullptr, pboFlags);
+        _pbo_ptr = static_cast<uint8_t*>(glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, _frame_bytes * OUTPUT_PBO_COUNT, pboFlags));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if(!_pbo_ptr)
+        {
+            glDeleteBuffers(1, &_pbo);
+            throw std::runtime_error("Failed to map readback buffer!");
+        }
+    }
+    _encoder = std::thread(&OutputRecorder::encodeLoop, this);
+}
+
+OutputRecorder::~OutputRecorder()
+{
+    // queued frames are still encoded, in-flight readbacks are discarded
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_all();
+    _encoder.join();
+    for(int i = 0; i < OUTPUT_PBO_COUNT; i++)
+        if(_pbo_fence[i]) glDeleteSync(_pbo_fence[i]);
+    if(_pbo)
+    {
+        glUnmapNamedBuffer(_pbo);
+        glDeleteBuffers(1, &_pbo);
+    }
+}
+
+void OutputRecorder::capture()
+{
+    if(!_pbo) return;
+    collect();
+    if(_pending == OUTPUT_PBO_COUNT)
+    {
+        // GPU is behind, skip this frame instead of waiting
+        _dropped++;
+        return;
+    }
+    int slot = (_head + _pending) % OUTPUT_PBO_COUNT;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    // BGRA matches native framebuffer layout on most drivers (no conversion)
+    glReadPixels(0, 0, _width, _height, GL_BGRA, GL_UNSIGNED_BYTE,
+        reinterpret_cast<void*>(_frame_bytes * slot));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _pbo_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _pending++;
+    _captured++;
+}
+
+void OutputRecorder::collect()
+{
+    while(_pending)
+    {
+        GLsync& fence = _pbo_fence[_head];
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(fence);
+        fence = nullptr;
+        cv::Mat frame;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(!_free.empty())
+            {
+                frame = _free.back();
+                _free.pop_back();
+            }
+        }
+        frame.create(_height, _width, CV_8UC4);
+        std::memcpy(frame.data, _pbo_ptr + _frame_bytes * _head, _frame_bytes);
+        submit(frame);
+        _head = (_head + 1) % OUTPUT_PBO_COUNT;
+        _pending--;
+    }
+}
+
+bool OutputRecorder::submit(cv::Mat& frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_queue.size() >= OUTPUT_QUEUE_SIZE)
+        {
+            // encoder is behind, drop rather than block caller
+            _dropped++;
+            return false;
+        }
+        _queue.push_back(frame);
+    }
+    _cond.notify_one();
+    return true;
+}
+
+void OutputRecorder::encodeLoop()
+{
+    cv::Mat flipped, bgr;
+    while(true)
+    {
+        cv::Mat frame;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [this]() {return !_running || !_queue.empty();});
+            if(_queue.empty()) return;
+            frame = _queue.front();
+            _queue.pop_front();
+        }
+        // framebuffer rows start at the bottom
+        cv::flip(frame, flipped, 0);
+        cv::cvtColor(flipped, bgr, cv::COLOR_BGRA2BGR);
+        if(_sink->write(bgr)) _written++;
+        else std::cout << "Failed to write frame to " << _sink->name() << std::endl;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free.push_back(frame);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#define OUTPUT_PBO_COUNT 3
+// frames waiting for encoder, newer frames are dropped when full
+#define OUTPUT_QUEUE_SIZE 8
+
+// destination of recorded frames, called on encoder thread only
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    // frame is top-down BGR
+    virtual bool write(const cv::Mat& frame) = 0;
+    virtual std::string name() const = 0;
+
+    // video file for .mp4/.avi/.mkv, otherwise an existing directory for numbered PNG files
+    static std::shared_ptr<FrameSink> create(const std::string& path, int width, int height, double fps);
+};
+
+class VideoFileSink : public FrameSink
+{
+public:
+    VideoFileSink(const std::string& path, int width, int height, double fps);
+    ~VideoFileSink();
+
+    bool write(const cv::Mat& frame);
+    std::string name() const {return _path;}
+
+private:
+    std::string _path;
+    cv::VideoWriter _writer;
+};
+
+class ImageFileSink : public FrameSink
+{
+public:
+    ImageFileSink(const std::string& directory) : _directory(directory) {}
+
+    bool write(const cv::Mat& frame);
+    std::string name() const {return _directory;}
+
+private:
+    std::string _directory;
+    unsigned _index = 0;
+};
+
+// records the composited output without stalling the GL thread
+// framebuffer is read back into a ring of persistently mapped PBOs,
+// finished readbacks go through a bounded queue to an encoder thread
+class OutputRecorder
+{
+public:
+    OutputRecorder(std::shared_ptr<FrameSink> sink, int width, int height);
+    ~OutputRecorder();
+
+    // GL thread: collect finished readbacks and start reading current framebuffer
+    // never waits for the GPU, frame is dropped if every PBO is still in flight
+    void capture();
+    // any thread: queue a bottom-up BGRA frame for encoding, return false if dropped
+    // (also the entry point for feeding frames without GL)
+    bool submit(cv::Mat& frame);
+
+    std::string name() const {return _sink->name();}
+    unsigned captured() const {return _captured;}
+    unsigned written() const {return _written;}
+    unsigned dropped() const {return _dropped;}
+    // framebuffer size frames are read at, fixed for the recording
+    int width() const {return _width;}
+    int height() const {return _height;}
+
+private:
+    std::shared_ptr<FrameSink> _sink;
+    int _width, _height;
+    size_t _frame_bytes;
+    // readback ring, slots _head.._head+_pending-1 are in flight
+    GLuint _pbo = 0;
+    uint8_t* _pbo_ptr = nullptr;
+    GLsync _pbo_fence[OUTPUT_PBO_COUNT];
+    int _head = 0, _pending = 0;
+    // encoder queue and recycled frame buffers
+    std::deque<cv::Mat> _queue;
+    std::vector<cv::Mat> _free;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _running = true;
+    std::thread _encoder;
+    std::atomic<unsigned> _captured, _written, _dropped;
+
+    void collect();
+    void encodeLoop();
+};
\ No newline at end of file
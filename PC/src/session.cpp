@@ -0,0 +1,222 @@
+#include "session.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(SessionHeader) == 40, "Session header layout changed!");
+static_assert(sizeof(SessionFrame) == 24, "Session index layout changed!");
+
+SessionWriter::SessionWriter(const std::string& path, PixelFormat format,
+    int width, int height, bool compress)
+    : _path(path), _file(path.c_str(), std::ios::binary | std::ios::trunc),
+    _compress(compress && format == PixelFormat::BGR), _offset(0)
+{
+    if(!_file.is_open())
+        throw std::runtime_error("Failed to create session file: " + path);
+    std::memset(&_header, 0, sizeof(_header));
+    std::strncpy(_header.magic, SESSION_MAGIC, sizeof(_header.magic));
+    _header.version = SESSION_VERSION;
+    _header.format = static_cast<uint32_t>(_compress ? PixelFormat::JPEG : format);
+    _header.width = width;
+    _header.height = height;
+    // header is rewritten with index position on close
+    _file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+    _offset = sizeof(_header);
+}
+
+SessionWriter::~SessionWriter()
+{
+    close();
+}
+
+bool SessionWriter::write(const cv::Mat& frame, double timestamp)
+{
+    if(!_file.is_open() || frame.empty()) return false;
+    const uint8_t* data = frame.data;
+    size_t size = frame.total() * frame.elemSize();
+    cv::Mat packed;
+    if(_compress)
+    {
+        cv::imencode(".jpg", frame, _buffer);
+        data = _buffer.data();
+        size = _buffer.size();
+    }
+    else if(!frame.isContinuous())
+    {
+        packed = frame.clone();
+        data = packed.data;
+    }
+    // align frame start so replayed Mat rows are nicely aligned for memcpy
+    static const char padding[SESSION_ALIGN] = {};
+    size_t pad = (SESSION_ALIGN - _offset % SESSION_ALIGN) % SESSION_ALIGN;
+    _file.write(padding, static_cast<std::streamsize>(pad));
+    _offset += pad;
+    _file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if(!_file) return false;
+    SessionFrame entry;
+    entry.offset = _offset;
+    entry.size = size;
+    entry.timestamp = timestamp;
+    _index.push_back(entry);
+    _offset += size;
+    return true;
+}
+
+void SessionWriter::close()
+{
+    if(!_file.is_open()) return;
+    // index goes after the last frame
+    _header.frameCount = _index.size();
+    _header.indexOffset = _offset;
+    if(!_index.empty())
+        _file.write(reinterpret_cast<const char*>(_index.data()),
+            static_cast<std::streamsize>(_index.size() * sizeof(SessionFrame)));
+    _file.seekp(0);
+    _file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+    _file.close();
+}
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef _WIN32
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(_file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open session file: " + path);
+    LARGE_INTEGER size;
+    GetFileSizeEx(_file, &size);
+    _size = static_cast<size_t>(size.QuadPart);
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(_mapping) _data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!_data)
+    {
+        if(_mapping) CloseHandle(_mapping);
+        CloseHandle(_file);
+        throw std::runtime_error("Failed to map session file: " + path);
+    }
+#else
+    _fd = open(path.c_str(), O_RDONLY);
+    if(_fd < 0)
+        throw std::runtime_error("Failed to open session file: " + path);
+    struct stat info;
+    fstat(_fd, &info);
+    _size = static_cast<size_t>(info.st_size);
+    void* data = _size ? mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0) : MAP_FAILED;
+    if(data == MAP_FAILED)
+    {
+        ::close(_fd);
+        throw std::runtime_error("Failed to map session file: " + path);
+    }
+    _data = static_cast<const uint8_t*>(data);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+    CloseHandle(_file);
+#else
+    munmap(const_cast<uint8_t*>(_data), _size);
+    ::close(_fd);
+#endif
+}
+
+void MappedFile::prefetch()
+{
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<uint8_t*>(_data);
+    range.NumberOfBytes = _size;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    madvise(const_cast<uint8_t*>(_data), _size, MADV_WILLNEED);
+#endif
+}
+
+SessionSource::SessionSource(const std::string& path, ReplayMode mode)
+    : ReplaySource(mode, 30.0), _path(path), _map(path)
+{
+    const SessionHeader* header = reinterpret_cast<const SessionHeader*>(_map.data());
+    if(_map.size() < sizeof(SessionHeader) || std::strncmp(header->magic, SESSION_MAGIC, sizeof(header->magic)))
+        throw std::runtime_error("Not a session file: " + path);
+    if(header->version != SESSION_VERSION || header->format > static_cast<uint32_t>(PixelFormat::JPEG))
+        throw std::runtime_error("Unsupported session version: " + path);
+    // luma-only frames cannot be shown or uploaded by Camera
+    if(header->format == static_cast<uint32_t>(PixelFormat::GRAY))
+        throw std::runtime_error("GRAY sessions are not supported: " + path);
+    if(header->frameCount == 0 ||
+        header->indexOffset + header->frameCount * sizeof(SessionFrame) > _map.size())
+        throw std::runtime_error("Session file is empty or was not closed: " + path);
+    _width = header->width;
+    _height = header->height;
+    _format = static_cast<PixelFormat>(header->format);
+    _count = static_cast<size_t>(header->frameCount);
+    _index = reinterpret_cast<const SessionFrame*>(_map.data() + header->indexOffset);
+    size_t bytes = frameBytes(_format, _width, _height);
+    for(size_t i = 0; i < _count; i++)
+        if(_index[i].offset + _index[i].size > header->indexOffset ||
+            (_format != PixelFormat::JPEG && _index[i].size != bytes))
+            throw std::runtime_error("Corrupted session index: " + path);
+    // benchmarks should not wait for page faults
+    if(_mode == ReplayMode::Fast) _map.prefetch();
+    seek(0);
+}
+
+void SessionSource::seek(size_t frame)
+{
+    _current = std::min(frame, _count - 1);
+    _replayStart = std::chrono::steady_clock::now();
+    _timestampStart = _index[_current].timestamp;
+}
+
+bool SessionSource::read(cv::Mat& frame)
+{
+    if(_finished) return false;
+    if(_current >= _count)
+    {
+        if(_mode == ReplayMode::Fast)
+        {
+            _finished = true;
+            return false;
+        }
+        // loop realtime replay from the beginning
+        seek(0);
+    }
+    const SessionFrame& entry = _index[_current];
+    // realtime replay keeps recorded frame timing
+    if(_mode == ReplayMode::Realtime)
+        std::this_thread::sleep_until(_replayStart +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(entry.timestamp - _timestampStart)));
+    // header on mapped memory, pages are read-only
+    uchar* data = const_cast<uchar*>(_map.data() + entry.offset);
+    switch(_format)
+    {
+        case PixelFormat::YUYV:
+            frame = cv::Mat(_height, _width, CV_8UC2, data);
+            break;
+        case PixelFormat::NV12:
+            frame = cv::Mat(_height * 3 / 2, _width, CV_8UC1, data);
+            break;
+        case PixelFormat::JPEG:
+            frame = cv::Mat(1, static_cast<int>(entry.size), CV_8UC1, data);
+            break;
+        default:
+            frame = cv::Mat(_height, _width, CV_8UC3, data);
+            break;
+    }
+    _current++;
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include "framesource.hpp"
+
+// recorded session file (.mrk)
+// [header][frame 0][frame 1]...[index]
+// frames are stored as delivered by the source (or JPEG compressed),
+// each one 64 byte aligned so replay can hand out pointers into the mapping
+#define SESSION_MAGIC "MRKSESS"
+#define SESSION_VERSION 1
+#define SESSION_ALIGN 64
+
+struct SessionHeader
+{
+    char magic[8];
+    uint32_t version;
+    // PixelFormat of stored frames
+    uint32_t format;
+    int32_t width;
+    int32_t height;
+    uint64_t frameCount;
+    uint64_t indexOffset;
+};
+
+struct SessionFrame
+{
+    uint64_t offset;
+    uint64_t size;
+    // capture time in seconds since recording started
+    double timestamp;
+};
+
+// appends captured frames to a session file, index is written on close
+class SessionWriter
+{
+public:
+    // compress stores BGR frames as JPEG
+    SessionWriter(const std::string& path, PixelFormat format, int width, int height, bool compress);
+    ~SessionWriter();
+
+    bool write(const cv::Mat& frame, double timestamp);
+    void close();
+    size_t frames() const {return _index.size();}
+    const std::string& path() const {return _path;}
+
+private:
+    std::string _path;
+    std::ofstream _file;
+    SessionHeader _header;
+    std::vector<SessionFrame> _index;
+    bool _compress;
+    std::vector<uchar> _buffer;
+    uint64_t _offset;
+};
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    const uint8_t* data() const {return _data;}
+    size_t size() const {return _size;}
+    // ask OS to page in whole file ahead of replay
+    void prefetch();
+
+private:
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#else
+    int _fd = -1;
+#endif
+};
+
+// replays a session file straight from its memory mapping
+// frames are cv::Mat headers on mapped memory, no copy and no read per frame
+class SessionSource : public ReplaySource
+{
+public:
+    SessionSource(const std::string& path, ReplayMode mode);
+
+    bool read(cv::Mat& frame);
+    std::string name() const {return "Session (" + _path + ")";}
+
+    size_t frameCount() const {return _count;}
+    // random access, next read returns this frame
+    void seek(size_t frame);
+
+private:
+    std::string _path;
+    MappedFile _map;
+    const SessionFrame* _index = nullptr;
+    size_t _count = 0;
+    size_t _current = 0;
+    // realtime pacing by recorded timestamps
+    std::chrono::steady_clock::time_point _replayStart;
+    double _timestampStart = 0.0;
+};
\ No newline at end of file
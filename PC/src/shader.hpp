@@ -8,6 +8,14 @@
 #include <stdexcept>
 #include <fstream>
 #include <sstream>
+#include <map>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+// preprocessor defines of one program variant, name -> value
+// (ordered, so equal sets give equal cache keys)
+typedef std::map<std::string, std::string> ShaderDefines;
 
 class Shader
 {
@@ -19,7 +27,8 @@ public:
         if(compiled) glDeleteProgram(_program);
     }
 
-    void add(const std::string& source, GLenum type)
+    // defines are inserted right after #version, shaders give defaults with #ifndef
+    void add(const std::string& source, GLenum type, const ShaderDefines& defines = ShaderDefines())
     {
         if(compiled) return;
 
@@ -33,6 +42,27 @@ public:
         buffer << inFile.rdbuf();
 
         std::string contentStr = buffer.str();
+        std::string variant;
+        if(!defines.empty())
+        {
+            size_t line = 0;
+            size_t version = contentStr.find("#version");
+            if(version != std::string::npos)
+            {
+                line = contentStr.find('\n', version);
+                line = line == std::string::npos ? contentStr.size() : line + 1;
+            }
+            std::string block;
+            for(auto& define : defines)
+            {
+                block += "#define " + define.first + " " + define.second + "\n";
+                variant += " " + define.first + "=" + define.second;
+            }
+            // keep line numbers of compile errors matching the file
+            int lines = static_cast<int>(std::count(contentStr.begin(), contentStr.begin() + line, '\n'));
+            block += "#line " + std::to_string(lines + 1) + "\n";
+            contentStr.insert(line, block);
+        }
         const char* content = contentStr.c_str();
         GLuint shader = glCreateShader(type);
         glShaderSource(shader, 1, &content, nullptr);
@@ -46,7 +76,7 @@ public:
             glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
             std::vector<GLchar> infoLog(infoLen+1);
             glGetShaderInfoLog(shader, infoLen, nullptr, &infoLog[0]);
-            std::string content = "Shader " + source + " failed to compile: " +
+            std::string content = "Shader " + source + variant + " failed to compile: " +
                 std::string(&infoLog[0]);
             throw std::runtime_error(content);
         }
@@ -98,6 +128,18 @@ public:
         glUniform1f(glGetUniformLocation(_program, name), val);
     }
 
+    void uniformFloatArray(const char* name, const float* vals, int count) const
+    {
+        if(!compiled) return;
+        glUniform1fv(glGetUniformLocation(_program, name), count, vals);
+    }
+
+    void uniformIVec2(const char* name, const glm::ivec2& val) const
+    {
+        if(!compiled) return;
+        glUniform2iv(glGetUniformLocation(_program, name), 1, glm::value_ptr(val));
+    }
+
     void uniformVec2(const char* name, const glm::vec2& val) const
     {
         if(!compiled) return;
@@ -135,4 +177,45 @@ public:
 private:
     GLuint _program;
     std::vector<GLuint> _shaders;
-};
\ No newline at end of file
+};
+
+// programs shared between pipelines, each list of sources and define set
+// is compiled once and kept alive as long as somebody holds it
+// only use from GL thread
+class ShaderCache
+{
+public:
+    typedef std::vector<std::pair<std::string, GLenum>> Sources;
+
+    static std::shared_ptr<Shader> get(const Sources& sources, const ShaderDefines& defines = ShaderDefines())
+    {
+        std::weak_ptr<Shader>& cached = programs()[key(sources, defines)];
+        std::shared_ptr<Shader> shader = cached.lock();
+        if(shader) return shader;
+        shader = std::make_shared<Shader>();
+        for(auto& source : sources) shader->add(source.first, source.second, defines);
+        shader->compile();
+        cached = shader;
+        return shader;
+    }
+
+    static std::shared_ptr<Shader> compute(const std::string& source, const ShaderDefines& defines = ShaderDefines())
+    {
+        return get({{source, GL_COMPUTE_SHADER}}, defines);
+    }
+
+    static std::string key(const Sources& sources, const ShaderDefines& defines)
+    {
+        std::string key;
+        for(auto& source : sources) key += source.first + ";";
+        for(auto& define : defines) key += "|" + define.first + "=" + define.second;
+        return key;
+    }
+
+private:
+    static std::map<std::string, std::weak_ptr<Shader>>& programs()
+    {
+        static std::map<std::string, std::weak_ptr<Shader>> cache;
+        return cache;
+    }
+};
@@ -0,0 +1,137 @@
+#include "shmsource.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+ShmSource::ShmSource(const std::string& name) : _name(name)
+{
+#ifdef _WIN32
+    _mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+    if(!_mapping)
+        throw std::runtime_error("Failed to open shared memory: " + name);
+    _data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info;
+    if(_data && VirtualQuery(_data, &info, sizeof(info))) _size = info.RegionSize;
+    if(!_data)
+    {
+        CloseHandle(_mapping);
+        throw std::runtime_error("Failed to map shared memory: " + name);
+    }
+#else
+    // read-only mapping, consumers never touch producer state
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        throw std::runtime_error("Failed to open shared memory: " + name);
+    struct stat info;
+    fstat(fd, &info);
+    _size = static_cast<size_t>(info.st_size);
+    void* data = _size ? mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(data == MAP_FAILED)
+        throw std::runtime_error("Failed to map shared memory: " + name);
+    _data = static_cast<const uint8_t*>(data);
+#endif
+    _ring = reinterpret_cast<const ShmRingHeader*>(_data);
+    if(_size < sizeof(ShmRingHeader) || std::strncmp(_ring->magic, SHM_RING_MAGIC, sizeof(_ring->magic)))
+        throw std::runtime_error("Not a frame ring: " + name);
+    if(_ring->version != SHM_RING_VERSION || _ring->slotCount == 0 || _ring->slotBytes % 64 ||
+        _ring->format > static_cast<uint32_t>(PixelFormat::JPEG))
+        throw std::runtime_error("Unsupported frame ring: " + name);
+    // luma-only frames cannot be shown or uploaded by Camera
+    if(_ring->format == static_cast<uint32_t>(PixelFormat::GRAY))
+        throw std::runtime_error("GRAY frames are not supported: " + name);
+    _slotSize = sizeof(ShmSlotHeader) + static_cast<size_t>(_ring->slotBytes);
+    if(sizeof(ShmRingHeader) + _ring->slotCount * _slotSize > _size)
+        throw std::runtime_error("Frame ring is larger than shared memory: " + name);
+    _width = _ring->width;
+    _height = _ring->height;
+    _format = static_cast<PixelFormat>(_ring->format);
+    // only frames published from now on are consumed
+    _lastIndex = _ring->writeIndex.load(std::memory_order_acquire);
+}
+
+ShmSource::~ShmSource()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+#else
+    munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+}
+
+bool ShmSource::wrap(const ShmSlotHeader* slot, cv::Mat& view) const
+{
+    if(slot->format != _ring->format || slot->bytes > _ring->slotBytes) return false;
+    uchar* data = const_cast<uchar*>(reinterpret_cast<const uchar*>(slot + 1));
+    if(_format == PixelFormat::JPEG)
+    {
+        view = cv::Mat(1, static_cast<int>(slot->bytes), CV_8UC1, data);
+        return slot->bytes > 0;
+    }
+    int rows = _height, type = CV_8UC3;
+    switch(_format)
+    {
+        case PixelFormat::YUYV: type = CV_8UC2; break;
+        case PixelFormat::NV12: rows = _height * 3 / 2; type = CV_8UC1; break;
+        default: break;
+    }
+    size_t rowBytes = static_cast<size_t>(_width) * CV_ELEM_SIZE(type);
+    // last row does not need padding
+    if(slot->stride < rowBytes ||
+        static_cast<uint64_t>(slot->stride) * (rows - 1) + rowBytes > slot->bytes)
+        return false;
+    view = cv::Mat(rows, _width, type, data, slot->stride);
+    return true;
+}
+
+bool ShmSource::read(cv::Mat& frame)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHM_FRAME_TIMEOUT);
+    while(std::chrono::steady_clock::now() < deadline)
+    {
+        uint64_t written = _ring->writeIndex.load(std::memory_order_acquire);
+        if(written == _lastIndex)
+        {
+            // no futex across processes here, producer frame interval is orders of magnitude longer
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        // always newest frame, older ones are dropped like a webcam would
+        const ShmSlotHeader* newest = slot(written - 1);
+        uint64_t sequence = newest->sequence.load(std::memory_order_acquire);
+        cv::Mat view;
+        bool valid = !(sequence & 1) && wrap(newest, view);
+        uint64_t frameId = newest->frameId;
+        int64_t timestamp = newest->timestamp;
+        // copy inside the check, the slot may be rewritten as soon as we leave it,
+        // frame matching the slot layout is written in place (Camera's upload buffer)
+        if(valid) view.copyTo(frame);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // producer touched the slot while we were reading it
+        if(newest->sequence.load(std::memory_order_relaxed) != sequence) valid = false;
+        _lastIndex = written;
+        if(!valid)
+        {
+            _skipped++;
+            continue;
+        }
+        if(_lastFrameId && frameId > _lastFrameId + 1) _skipped += frameId - _lastFrameId - 1;
+        _lastFrameId = frameId;
+        // producers without timestamps are measured from here
+        _captured = timestamp ? std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(timestamp))) : std::chrono::steady_clock::now();
+        return true;
+    }
+    return false;
+}
\ No newline at end of file
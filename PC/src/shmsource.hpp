@@ -0,0 +1,94 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include "framesource.hpp"
+
+// frame ring shared with an external capture process
+// layout of shared memory object (e.g. /dev/shm/<name>):
+// [ShmRingHeader][ShmSlotHeader][slot data]...[ShmSlotHeader][slot data]
+// slot i starts at sizeof(ShmRingHeader) + i * (sizeof(ShmSlotHeader) + slotBytes)
+// producer writes a frame into slot (writeIndex % slotCount):
+//   sequence += 1 (odd, writing), fill data and fields, sequence += 1 (even, release store),
+//   then writeIndex += 1 (release store)
+// consumers never write, they copy the newest slot and check sequence did not change,
+// frames torn by a producer lapping the ring are dropped
+#define SHM_RING_MAGIC "MRKSHM1"
+#define SHM_RING_VERSION 1
+// give up waiting for a new frame after this many milliseconds
+#define SHM_FRAME_TIMEOUT 100
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory ring needs lock-free 64 bit atomics!");
+
+struct alignas(64) ShmRingHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slotCount;
+    // capacity of one slot, multiple of 64
+    uint64_t slotBytes;
+    // PixelFormat, fixed for the stream
+    uint32_t format;
+    int32_t width;
+    int32_t height;
+    uint32_t reserved;
+    // frames published so far
+    std::atomic<uint64_t> writeIndex;
+};
+
+struct alignas(64) ShmSlotHeader
+{
+    // odd while producer writes the slot
+    std::atomic<uint64_t> sequence;
+    uint64_t frameId;
+    // CLOCK_MONOTONIC nanoseconds (steady_clock of consumer)
+    int64_t timestamp;
+    uint32_t format;
+    // bytes per row, NV12 planes share it
+    uint32_t stride;
+    // payload size
+    uint64_t bytes;
+};
+
+// consumes the newest frame of a shared memory ring
+// payload is copied into the frame it is given inside the sequence check,
+// Camera passes a header on its mapped upload buffer so this is the only copy,
+// frames never alias the shared pages
+class ShmSource : public FrameSource
+{
+public:
+    ShmSource(const std::string& name);
+    ~ShmSource();
+
+    bool read(cv::Mat& frame);
+    std::string name() const {return "Shared Memory (" + _name + ")";}
+    std::chrono::steady_clock::time_point captured() const {return _captured;}
+
+    // frames skipped because producer was faster or slot was rewritten while reading
+    uint64_t skipped() const {return _skipped;}
+
+private:
+    std::string _name;
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* _mapping = nullptr;
+#endif
+    const ShmRingHeader* _ring = nullptr;
+    size_t _slotSize = 0;
+    uint64_t _lastIndex = 0;
+    uint64_t _lastFrameId = 0;
+    uint64_t _skipped = 0;
+    std::chrono::steady_clock::time_point _captured;
+
+    const ShmSlotHeader* slot(uint64_t index) const
+    {
+        return reinterpret_cast<const ShmSlotHeader*>(
+            _data + sizeof(ShmRingHeader) + (index % _ring->slotCount) * _slotSize);
+    }
+    // view of slot payload, false if slot does not describe a valid frame
+    bool wrap(const ShmSlotHeader* slot, cv::Mat& view) const;
+};
\ No newline at end of file
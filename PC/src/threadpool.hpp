@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// fixed set of worker threads running submitted tasks in order
+// used for CPU side work that must stay off the GL thread
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned threads) : _running(true)
+    {
+        if(threads == 0) threads = 1;
+        for(unsigned i = 0; i < threads; i++)
+            _workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _cond.notify_all();
+        for(auto& worker : _workers) worker.join();
+    }
+
+    // queue a task, returned future rethrows its exception on get()
+    std::future<void> submit(std::function<void()> task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(task);
+        std::future<void> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push([packaged]() {(*packaged)();});
+        }
+        _cond.notify_one();
+        return result;
+    }
+
+    unsigned size() const {return static_cast<unsigned>(_workers.size());}
+
+private:
+    std::vector<std::thread> _workers;
+    std::queue<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _running;
+
+    void workerLoop()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [this]() {return !_running || !_tasks.empty();});
+                if(!_running && _tasks.empty()) return;
+                task = std::move(_tasks.front());
+                _tasks.pop();
+            }
+            task();
+        }
+    }
+};
\ No newline at end of file
@@ -7,38 +7,99 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
-void Camera::getValidSecondaryCamera(
-    int& cameraId, int& apiPreference
-)
+// runs on capture thread, keeps decoding frames into the triple buffer
+// so render thread never waits on driver or MJPEG decode
+void Camera::captureLoop()
 {
-    cv::VideoCapture tmp;
-#ifdef linux
-    cameraId = 5;
-#else
-    cameraId = 0;
-#endif
-    for(; cameraId >= 0; cameraId--)
+    cv::Mat compressed;
+    int lumaFlag = cv::IMREAD_GRAYSCALE;
+    if(_luma_scale == 2) lumaFlag = cv::IMREAD_REDUCED_GRAYSCALE_2;
+    else if(_luma_scale == 4) lumaFlag = cv::IMREAD_REDUCED_GRAYSCALE_4;
+    while(_capture_running)
     {
-        if(tmp.open(cameraId, cv::CAP_DSHOW))
+        // deterministic sources wait until render thread took the last frame
+        if(_source->deterministic() && _frames.pending())
         {
-            apiPreference = cv::CAP_DSHOW;
-            tmp.release();
-            break;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
         }
-        else if(tmp.open(cameraId, cv::CAP_V4L2))
+        bool compressedInput = _format == PixelFormat::JPEG;
+        CameraFrame& frame = _frames.back();
+        // read (or decode below) straight into the slot's upload region
+        frame.image = frame.staging;
+        if(!_source->read(compressedInput ? compressed : frame.image))
         {
-            apiPreference = cv::CAP_V4L2;
-            tmp.release();
-            break;
+            if(_source->finished()) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
         }
-        else if(tmp.open(cameraId, cv::CAP_ANY))
+        // latency is measured from here unless source knows better
+        frame.captured = _source->captured();
+        frame.id = _frames_captured;
+        record(compressedInput ? compressed : frame.image, frame.captured);
+        if(compressedInput)
         {
-            apiPreference = cv::CAP_ANY;
-            tmp.release();
-            break;
+            // detection only needs luma, libjpeg skips chroma
+            // and scales down in DCT domain for reduced sizes
+            cv::imdecode(compressed, lumaFlag, &frame.image);
+            if(!stage(frame)) continue;
+            // color decoding for display is left to color thread
+            compressed.copyTo(_jpegs.back().image);
+            _jpegs.back().id = frame.id;
+            _jpegs.publish();
         }
+        // sources with their own buffers are copied here, off the GL thread
+        else if(!stage(frame)) continue;
+        _frames.publish();
+        _frames_captured++;
     }
+    _capture_done = true;
+}
+
+// runs on capture thread, appends frame to session file if recording
+void Camera::record(const cv::Mat& frame, FrameTiming::Clock::time_point captured)
+{
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    if(!_recorder) return;
+    std::chrono::duration<double> timestamp = captured - _record_start;
+    if(_recorder->write(frame, std::max(0.0, timestamp.count()))) _frames_recorded++;
+}
+
+// runs on color thread, decodes MJPG frames to BGR for display only
+// skips work while the last color frame was not displayed yet
+// and decodes only every n-th frame if asked to
+void Camera::colorLoop()
+{
+    unsigned counter = 0;
+    while(_capture_running)
+    {
+        if(_colors.pending() || !_jpegs.consume())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if(counter++ % static_cast<unsigned>(std::max(1, static_cast<int>(_color_interval)))) continue;
+        CameraFrame& color = _colors.back();
+        color.image = color.staging;
+        cv::imdecode(_jpegs.front().image, cv::IMREAD_COLOR, &color.image);
+        color.id = _jpegs.front().id;
+        if(stage(color)) _colors.publish();
+    }
+}
+
+bool Camera::waitFirstFrame()
+{
+    auto start = std::chrono::steady_clock::now();
+    while(!_frames.pending())
+    {
+        if(_capture_done) return false;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if(elapsed.count() > CAMERA_FIRST_FRAME_TIMEOUT) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
 }
 
 void Camera::loadCameraData()
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// lock-free triple buffer for one producer thread and one consumer thread
+// producer always owns a back slot to write into,
+// consumer always owns a front slot to read from,
+// the middle slot is swapped atomically so consumer only sees the newest value
+// and older values are simply overwritten (dropped)
+template<typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : _state(1), _back(2), _front(0) {}
+
+    // producer: slot to write the next value into
+    T& back() {return _slots[_back];}
+    // producer: make back slot the newest value
+    void publish()
+    {
+        uint8_t prev = _state.exchange(
+            static_cast<uint8_t>(_back | TRIPLE_BUFFER_FRESH), std::memory_order_acq_rel);
+        _back = prev & TRIPLE_BUFFER_INDEX;
+    }
+    // producer: whether last published value has not been consumed yet
+    bool pending() const
+    {
+        return (_state.load(std::memory_order_acquire) & TRIPLE_BUFFER_FRESH) != 0;
+    }
+
+    // consumer: swap in the newest value if any, return false if nothing new
+    bool consume()
+    {
+        if(!pending()) return false;
+        uint8_t prev = _state.exchange(
+            static_cast<uint8_t>(_front), std::memory_order_acq_rel);
+        _front = prev & TRIPLE_BUFFER_INDEX;
+        return true;
+    }
+    // consumer: slot holding the last consumed value
+    T& front() {return _slots[_front];}
+
+    // setup only, before producer and consumer start: any slot by index
+    T& slot(int index) {return _slots[index];}
+
+private:
+    static const uint8_t TRIPLE_BUFFER_INDEX = 0x3;
+    static const uint8_t TRIPLE_BUFFER_FRESH = 0x4;
+
+    T _slots[3];
+    // middle slot index + fresh flag
+    std::atomic<uint8_t> _state;
+    // only touched by producer
+    uint8_t _back;
+    // only touched by consumer
+    uint8_t _front;
+};
\ No newline at end of file
@@ -2,19 +2,65 @@
 #include "context.hpp"
 #include "marker.hpp"
 #include "model.hpp"
+#include "latency.hpp"
 #include <imgui.h>
+#include <iostream>
+#include <cfloat>
 
 void Camera::UI()
 {
-    ImGui::Text("OpenCV Backend: %s", _backend.c_str());
-    ImGui::Text("Capture Size: %dx%d", _width, _height);
+    ImGui::Text("Source: %s", _source->name().c_str());
+    ImGui::Text("Capture Size: %dx%d (%s)", _width, _height, formatName(_format));
+    unsigned captured = _frames_captured;
+    ImGui::Text("Frames Captured: %u (dropped %u)", captured, captured - _frames_used);
+    if(_format == PixelFormat::JPEG)
+    {
+        ImGui::Text("Detection Size: %dx%d (luma 1/%d)", _detect_width, _detect_height, _luma_scale);
+        int interval = _color_interval;
+        if(ImGui::DragInt("Color Decode Interval", &interval, 0.1f, 1, 10))
+            _color_interval = interval;
+    }
+    ImGui::Separator();
+    if(_recording)
+    {
+        unsigned recorded = _frames_recorded;
+        ImGui::Text("Recording: %u frames", recorded);
+        if(ImGui::Button("Stop Recording")) stopRecording();
+    }
+    else
+    {
+        ImGui::InputText("Session File", _record_path, sizeof(_record_path));
+        if(_format == PixelFormat::BGR) ImGui::Checkbox("Compress (JPEG)", &_record_compress);
+        if(ImGui::Button("Start Recording"))
+        {
+            try
+            {
+                startRecording(_record_path, _record_compress);
+            }
+            catch(const std::exception& e)
+            {
+                std::cout << e.what() << std::endl;
+            }
+        }
+    }
     ImGui::Separator();
     ImGui::Checkbox("Denoising", &_denoise);
     if(_denoise)
     {
-        ImGui::DragFloat("Denoise Threshold", &_threshold, 0.001f, 0.001f, 0.5f, "%.3f");
-        ImGui::DragFloat("Denoise Sigma", &_sigma, 0.01f, 0.001f, 5.0f, "%.2f");
-        ImGui::DragFloat("Denoise kSigma", &_kSigma, 0.01f, 0.001f, 10.0f, "%.2f");
+        const char* denoiseModes[] = {"Spatial", "Temporal"};
+        ImGui::Combo("Denoise Mode", &_denoise_mode, denoiseModes, 2);
+        if(_denoise_mode == static_cast<int>(DenoiseMode::Temporal))
+        {
+            ImGui::DragFloat("Denoise Blend", &_temporal_blend, 0.001f, 0.02f, 1.0f, "%.3f");
+            ImGui::DragFloat("Denoise Motion", &_temporal_motion, 0.001f, 0.005f, 0.5f, "%.3f");
+        }
+        else
+        {
+            ImGui::DragFloat("Denoise Threshold", &_threshold, 0.001f, 0.001f, 0.5f, "%.3f");
+            ImGui::DragFloat("Denoise Sigma", &_sigma, 0.01f, 0.1f, 5.0f, "%.2f");
+            ImGui::DragFloat("Denoise kSigma", &_kSigma, 0.01f, 0.001f, 10.0f, "%.2f");
+            ImGui::Text("Radius: %d (max %d)", _denoise_radius, DENOISE_MAX_RADIUS);
+        }
     }
     ImGui::Separator();
     ImGui::Text("Camera Calibration");
@@ -28,27 +74,77 @@ void Context::UI()
 {
     ImGui::Text("Window Size: %dx%d", _winWidth, _winHeight);
     ImGui::Text("FPS: %.2f", ImGui::GetIO().Framerate);
+    ImGui::Separator();
+    if(_recorder)
+    {
+        ImGui::Text("Recording: %s", _recorder->name().c_str());
+        ImGui::Text("Frames: %u written, %u dropped", _recorder->written(), _recorder->dropped());
+        if(ImGui::Button("Stop Output Recording")) stopRecording();
+    }
+    else
+    {
+        ImGui::InputText("Output File", _record_path, sizeof(_record_path));
+        if(ImGui::Button("Start Output Recording"))
+        {
+            try
+            {
+                startRecording(_record_path);
+            }
+            catch(const std::exception& e)
+            {
+                std::cout << e.what() << std::endl;
+            }
+        }
+    }
+    ImGui::Separator();
     ImGui::Text("Author: Teamclouday");
 }
 
 void Marker::UI()
 {
+    if(_cpu_frame)
+        ImGui::Text("CPU Preprocessing (%s)", CpuPreprocessor::simd());
+    else
+        ImGui::Checkbox("Fused Preprocessing", &_fused);
+    ImGui::Separator();
     ImGui::Text("Grayscale");
     ImGui::DragInt("Shades", &_gray_shades, 1.0f, 1, 50);
     ImGui::Checkbox("Blur Filter", &_blur);
     if(_blur)
     {
-        ImGui::DragFloat("Blur Radius", &_blur_radius, 0.01f, 0.01f, 10.0f, "%.2f");
-        ImGui::DragFloat("Blur Quality", &_blur_quality, 0.01f, 0.01f, 10.0f, "%.2f");
-        ImGui::DragFloat("Blur Directions", &_blur_directions, 1.0f, 1.0f, 12.0f, "%.0f");
+        const char* blurModes[] = {"Directional", "Gaussian"};
+        ImGui::Combo("Blur Mode", &_blur_mode, blurModes, 2);
+        if(_blur_mode == static_cast<int>(BlurMode::Gaussian))
+            ImGui::DragFloat("Blur Sigma", &_blur_sigma, 0.01f, 0.3f, BLUR_MAX_RADIUS / 3.0f, "%.2f");
+        else
+        {
+            ImGui::DragFloat("Blur Radius", &_blur_radius, 0.01f, 0.01f, 10.0f, "%.2f");
+            ImGui::DragFloat("Blur Quality", &_blur_quality, 0.01f, 0.01f, 10.0f, "%.2f");
+            ImGui::DragFloat("Blur Directions", &_blur_directions, 1.0f, 1.0f, 12.0f, "%.0f");
+        }
     }
     ImGui::Separator();
     ImGui::Text("Thresholding");
-    ImGui::Checkbox("Auto", &_auto_threshold);
-    if(!_auto_threshold)
+    const char* thresholdModes[] = {"Manual", "Global Mean", "Adaptive", "Otsu"};
+    ImGui::Combo("Mode", &_threshold_mode, thresholdModes, 4);
+    if(_threshold_mode == static_cast<int>(ThresholdMode::Manual))
         ImGui::DragFloat("Manual", &_threshold, 0.001f, 0.0f, 1.0f, "%.3f");
+    else if(_threshold_mode == static_cast<int>(ThresholdMode::Global))
+        ImGui::Text("Mean: %.3f", _threshold);
+    else if(_threshold_mode == static_cast<int>(ThresholdMode::Otsu))
+        ImGui::Text("Level: %.3f", _threshold);
+    else if(_threshold_mode == static_cast<int>(ThresholdMode::Adaptive))
+    {
+        ImGui::SliderInt("Tile Size", &_adaptive_tile, 16, 128);
+        ImGui::DragFloat("Offset", &_adaptive_offset, 0.001f, -0.5f, 0.5f, "%.3f");
+    }
     ImGui::Separator();
     ImGui::Text("Contour Tracing");
+    ImGui::Checkbox("Async Readback (+1 frame latency)", &_async_readback);
+    ImGui::Checkbox("Refine Corners (full resolution)", &_refine_corners);
+    ImGui::Checkbox("Track ROI", &_roi_tracking);
+    ImGui::SameLine();
+    ImGui::Text("%d x %d", _roi.z - _roi.x, _roi.w - _roi.y);
     ImGui::DragInt("Max Iteration", &_tracing_max_iter, 5.0f, 200, 10000);
     ImGui::DragInt("Min Contour Length", &_tracing_thres_contour, 5.0f, 10, 5000);
     ImGui::DragFloat("Min Quadra Distance", &_tracing_thres_quadra, 0.01f, 0.01f, 20.0f, "%.2f");
@@ -154,4 +250,41 @@ void ModelSpiderMan::UI()
     ImGui::DragFloat("Scale", &_scale, 0.001f, 0.001f, 100.0f, "%.3f");
     ImGui::Separator();
     ImGui::DragFloat3("Light Pos", &_lightPos[0], 0.01f);
-}
\ No newline at end of file
+}
+
+void LatencyTracker::UI()
+{
+    if(!_frames)
+    {
+        ImGui::Text("No frames processed yet");
+        return;
+    }
+    int count = static_cast<int>(std::min<uint64_t>(_frames, LATENCY_HISTORY));
+    int lastIdx = static_cast<int>(_last);
+    ImGui::Text("Frames: %llu (dropped before processing %llu)",
+        static_cast<unsigned long long>(_frames), static_cast<unsigned long long>(_dropped));
+    ImGui::Separator();
+    // delta of each stage to the previous one over the last frames
+    for(int i = 1; i <= lastIdx; i++)
+    {
+        float sum = 0.0f, max = 0.0f;
+        for(int j = 0; j < count; j++)
+        {
+            sum += _deltas[i][j];
+            max = std::max(max, _deltas[i][j]);
+        }
+        ImGui::Text("%-10s avg %6.2f ms  max %6.2f ms", LatencyStageNames[i], sum / count, max);
+    }
+    ImGui::Separator();
+    float sum = 0.0f, max = 0.0f;
+    for(int j = 0; j < count; j++)
+    {
+        sum += _total[j];
+        max = std::max(max, _total[j]);
+    }
+    int lastFrame = (_index + LATENCY_HISTORY - 1) % LATENCY_HISTORY;
+    ImGui::Text("Capture -> %s", LatencyStageNames[lastIdx]);
+    ImGui::Text("last %6.2f ms  avg %6.2f ms  max %6.2f ms", _total[lastFrame], sum / count, max);
+    ImGui::PlotLines("##latency", _total, count, count < LATENCY_HISTORY ? 0 : _index,
+        nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 80.0f));
+}